@@ -287,6 +287,11 @@ public:
     uint64_t len,
     ceph::buffer::list *pbl,
     IOContext *ioc) = 0;
+  /// false if data returned by aio_read() in bl sits in scarce device
+  /// buffers that a cache should not hold on to
+  virtual bool is_cacheable(const ceph::buffer::list& bl) const {
+    return true;
+  }
   virtual int aio_write(
     uint64_t off,
     ceph::buffer::list& bl,
@@ -17,6 +17,7 @@
 
 #include "include/buffer.h"
 #include "include/types.h"
+#include "common/ceph_time.h"
 
 struct aio_t {
 #if defined(HAVE_LIBAIO)
@@ -35,6 +36,7 @@ struct aio_t {
   uint64_t offset, length;
   long rval;
   ceph::buffer::list bl;  ///< write payload (so that it remains stable for duration)
+  ceph::mono_time submit_stamp;  ///< when handed to the kernel, for latency
 
   boost::intrusive::list_member_hook<> queue_item;
 
@@ -104,6 +106,18 @@ struct io_queue_t {
   virtual int submit_batch(aio_iter begin, aio_iter end,
 			   void *priv, int *retries, int submit_retries, int initial_delay_us) = 0;
   virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+
+  /// allocate a buffer the queue can do I/O on without pinning it for
+  /// every request (e.g. io_uring registered buffers); nullptr if the
+  /// queue has no such buffers or all of them are in use
+  virtual ceph::unique_leakable_ptr<ceph::buffer::raw>
+  try_create_fixed_buffer(size_t len) {
+    return nullptr;
+  }
+  /// true if p points into a buffer from try_create_fixed_buffer()
+  virtual bool is_fixed_buffer(const char *p) const {
+    return false;
+  }
 };
 
 struct aio_queue_t final : public io_queue_t {
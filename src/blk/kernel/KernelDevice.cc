@@ -67,6 +67,7 @@ using ceph::bufferlist;
 using ceph::bufferptr;
 using ceph::make_timespan;
 using ceph::mono_clock;
+using ceph::mono_time;
 using ceph::operator <<;
 
 KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, aio_callback_t d_cb, void *d_cbpriv, const char* dev_name)
@@ -88,7 +89,10 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   if (use_ioring && ioring_queue_t::supported()) {
     bool use_ioring_hipri = cct->_conf.get_val<bool>("bdev_ioring_hipri");
     bool use_ioring_sqthread_poll = cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll");
-    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri, use_ioring_sqthread_poll);
+    auto fixed_buffer_size = cct->_conf.get_val<Option::size_t>("bdev_ioring_fixed_buffer_size");
+    auto fixed_buffers = cct->_conf.get_val<uint64_t>("bdev_ioring_fixed_buffers");
+    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri, use_ioring_sqthread_poll,
+                                                fixed_buffer_size, fixed_buffers);
   } else {
     static bool once;
     if (use_ioring && !once) {
@@ -108,6 +112,16 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
             "Number of discard ops issued to kernel device");
   b.add_u64_counter(l_blk_kernel_discard_threads, "discard_threads",
             "Number of discard threads running");
+  b.add_u64_counter(l_blk_kernel_device_fixed_buffer_read_op, "fixed_buffer_read_op",
+            "Number of reads issued into io_uring registered buffers");
+  b.add_time_avg(l_blk_kernel_device_aio_lat, "aio_lat",
+            "Average latency of aio reads and writes");
+  b.add_u64(l_blk_kernel_device_aio_inflight, "aio_inflight",
+            "Number of aios submitted and not yet completed");
+  b.add_u64_counter(l_blk_kernel_device_discard_deferred, "discard_deferred",
+            "Number of times async discards were held back by foreground io");
+  b.add_time_avg(l_blk_kernel_device_discard_deferred_lat, "discard_deferred_lat",
+            "Average time async discards were held back by foreground io");
 
   logger.reset(b.create_perf_counters());
   cct->get_perfcounters_collection()->add(logger.get());
@@ -670,9 +684,12 @@ void KernelDevice::_aio_thread()
     }
     if (r > 0) {
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
+      if (cct->_conf->bdev_debug_aio_complete_sleep > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(cct->_conf->bdev_debug_aio_complete_sleep));
       for (int i = 0; i < r; ++i) {
 	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
 	_aio_log_finish(ioc, aio[i]->offset, aio[i]->length);
+	_aio_note_finish(mono_clock::now() - aio[i]->submit_stamp);
 	if (aio[i]->queue_item.is_linked()) {
 	  std::lock_guard l(debug_queue_lock);
 	  debug_aio_unlink(*aio[i]);
@@ -739,6 +756,7 @@ void KernelDevice::_aio_thread()
           ioc->try_aio_wake();
 	}
       }
+      logger->set(l_blk_kernel_device_aio_inflight, aio_inflight.load());
     }
     if (cct->_conf->bdev_debug_aio) {
       utime_t now = ceph_clock_now();
@@ -787,6 +805,9 @@ void KernelDevice::_discard_thread(DiscardThread* thr)
 
   // Thread-local list of processing discards
   interval_set<uint64_t> discard_processing;
+  // set while we hold discards back because of foreground io
+  bool deferring = false;
+  mono_time defer_since;
 
   std::unique_lock l(discard_lock);
   discard_cond.notify_all();
@@ -811,6 +832,38 @@ void KernelDevice::_discard_thread(DiscardThread* thr)
       if (thr->stop && !discard_threads.empty())
         break;
 
+      // While the device is busy with foreground io, let discards pile
+      // up (and merge) in discard_queued instead of competing with it.
+      // A batch still goes out at least every
+      // bdev_async_discard_defer_max_ms, and right away if somebody is
+      // draining, so freed space keeps flowing back to the allocator.
+      auto max_defer = std::chrono::milliseconds(
+	cct->_conf.get_val<uint64_t>("bdev_async_discard_defer_max_ms"));
+      if (!thr->stop && !need_notify && max_defer.count() > 0 &&
+	  _discard_should_defer()) {
+	auto now = mono_clock::now();
+	if (!deferring) {
+	  deferring = true;
+	  defer_since = now;
+	  logger->inc(l_blk_kernel_device_discard_deferred);
+	}
+	auto deferred = now - defer_since;
+	if (deferred < max_defer) {
+	  dout(20) << __func__ << " deferring, aio_inflight " << aio_inflight
+		   << " aio_lat_avg_us " << aio_lat_avg_us << dendl;
+	  // re-check the load every few ms
+	  discard_cond.wait_for(
+	    l, std::min<ceph::timespan>(max_defer - deferred,
+					std::chrono::milliseconds(10)));
+	  continue;
+	}
+      }
+      if (deferring) {
+	logger->tinc(l_blk_kernel_device_discard_deferred_lat,
+		     mono_clock::now() - defer_since);
+	deferring = false;
+      }
+
       if (cct->_conf->bdev_debug_discard_sleep > 0)
         std::this_thread::sleep_for(std::chrono::milliseconds(cct->_conf->bdev_debug_discard_sleep));
 
@@ -851,6 +904,32 @@ void KernelDevice::_discard_thread(DiscardThread* thr)
   dout(10) << __func__ << " thread " << thr << " finish" << dendl;
 }
 
+// called with discard_lock held
+bool KernelDevice::_discard_should_defer() const
+{
+  uint64_t inflight = aio_inflight.load();
+  if (inflight == 0) {
+    return false;
+  }
+  // don't sit on a queue that is about to start refusing discards
+  auto max_pending = cct->_conf->bdev_async_discard_max_pending;
+  if ((max_pending > 0 && discard_queued.num_intervals() >= max_pending / 2) ||
+      discard_queue_bytes >= cct->_conf->bdev_discard_max_bytes / 2) {
+    return false;
+  }
+  auto max_inflight =
+    cct->_conf.get_val<uint64_t>("bdev_async_discard_defer_inflight");
+  if (max_inflight > 0 && inflight >= max_inflight) {
+    return true;
+  }
+  auto max_lat_us =
+    cct->_conf.get_val<uint64_t>("bdev_async_discard_defer_latency_us");
+  if (max_lat_us > 0 && aio_lat_avg_us.load() >= max_lat_us) {
+    return true;
+  }
+  return false;
+}
+
 // this is private and is expected that the caller checks that discard
 // threads are running via _discard_started()
 bool KernelDevice::_queue_discard(interval_set<uint64_t> &to_release)
@@ -974,6 +1053,18 @@ void KernelDevice::_aio_log_finish(
   }
 }
 
+// only called from the aio thread
+void KernelDevice::_aio_note_finish(ceph::timespan lat)
+{
+  logger->tinc(l_blk_kernel_device_aio_lat, lat);
+  // exponential moving average, new samples weigh 1/8
+  uint64_t us =
+    std::chrono::duration_cast<std::chrono::microseconds>(lat).count();
+  uint64_t avg = aio_lat_avg_us.load(std::memory_order_relaxed);
+  aio_lat_avg_us.store(avg - avg / 8 + us / 8, std::memory_order_relaxed);
+  --aio_inflight;
+}
+
 void KernelDevice::aio_submit(IOContext *ioc)
 {
   dout(20) << __func__ << " ioc " << ioc
@@ -1006,6 +1097,12 @@ void KernelDevice::aio_submit(IOContext *ioc)
     }
   }
 
+  auto now = mono_clock::now();
+  for (auto p = ioc->running_aios.begin(); p != e; ++p) {
+    p->submit_stamp = now;
+  }
+  aio_inflight += pending;
+
   void *priv = static_cast<void*>(ioc);
   int retry_max = cct->_conf->bdev_aio_submit_retry_max;
   int initial_delay_us = cct->_conf->bdev_aio_submit_retry_initial_delay_us;
@@ -1466,8 +1563,13 @@ int KernelDevice::aio_read(
     ioc->pending_aios.push_back(aio_t(ioc, fd_directs[WRITE_LIFE_NOT_SET]));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    aio.bl.push_back(
-      ceph::buffer::ptr_node::create(create_custom_aligned(len, ioc)));
+    if (auto fixed_raw = io_queue->try_create_fixed_buffer(len); fixed_raw) {
+      logger->inc(l_blk_kernel_device_fixed_buffer_read_op);
+      aio.bl.push_back(ceph::buffer::ptr_node::create(std::move(fixed_raw)));
+    } else {
+      aio.bl.push_back(
+        ceph::buffer::ptr_node::create(create_custom_aligned(len, ioc)));
+    }
     aio.bl.prepare_iov(&aio.iov);
     aio.preadv(off, len);
     dout(30) << aio << dendl;
@@ -1483,6 +1585,21 @@ int KernelDevice::aio_read(
   return r;
 }
 
+bool KernelDevice::is_cacheable(const bufferlist& bl) const
+{
+  // registered buffers are a scarce resource; don't let the cache keep
+  // them busy
+  if (!io_queue) {
+    return true;
+  }
+  for (auto& p : bl.buffers()) {
+    if (io_queue->is_fixed_buffer(p.c_str())) {
+      return false;
+    }
+  }
+  return true;
+}
+
 int KernelDevice::direct_read_unaligned(uint64_t off, uint64_t len, char *buf)
 {
   uint64_t aligned_off = p2align(off, block_size);
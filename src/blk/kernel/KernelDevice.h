@@ -33,6 +33,11 @@ enum {
   l_blk_kernel_device_first = 1000,
   l_blk_kernel_device_discard_op,
   l_blk_kernel_discard_threads,
+  l_blk_kernel_device_fixed_buffer_read_op,
+  l_blk_kernel_device_aio_lat,
+  l_blk_kernel_device_aio_inflight,
+  l_blk_kernel_device_discard_deferred,
+  l_blk_kernel_device_discard_deferred_lat,
   l_blk_kernel_device_last,
 };
 
@@ -53,6 +58,8 @@ private:
   interval_set<uint64_t> debug_inflight;
 
   std::atomic<bool> io_since_flush = {false};
+  std::atomic<uint64_t> aio_inflight = {0};   ///< submitted, not yet reaped
+  std::atomic<uint64_t> aio_lat_avg_us = {0}; ///< moving average aio latency
   ceph::mutex flush_mutex = ceph::make_mutex("KernelDevice::flush_mutex");
 
   std::unique_ptr<io_queue_t> io_queue;
@@ -95,6 +102,7 @@ private:
 
   void _aio_thread();
   void _discard_thread(DiscardThread* thr);
+  bool _discard_should_defer() const;
   bool _queue_discard(interval_set<uint64_t> &to_release);
   bool try_discard(interval_set<uint64_t> &to_release,
                    bool async = true,
@@ -109,6 +117,7 @@ private:
 
   void _aio_log_start(IOContext *ioc, uint64_t offset, uint64_t length);
   void _aio_log_finish(IOContext *ioc, uint64_t offset, uint64_t length);
+  void _aio_note_finish(ceph::timespan lat);
 
   int _sync_write(uint64_t off, ceph::buffer::list& bl, bool buffered, int write_hint);
 
@@ -153,6 +162,7 @@ public:
 	   bool buffered) override;
   int aio_read(uint64_t off, uint64_t len, ceph::buffer::list *pbl,
 	       IOContext *ioc) override;
+  bool is_cacheable(const ceph::buffer::list& bl) const override;
   int read_random(uint64_t off, uint64_t len, char *buf, bool buffered) override;
 
   int write(uint64_t off, ceph::buffer::list& bl, bool buffered, int write_hint = WRITE_LIFE_NOT_SET) override;
@@ -7,17 +7,92 @@
 
 #include "liburing.h"
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <map>
 
+#include <boost/lockfree/queue.hpp>
+
+#include "include/buffer_raw.h"
+#include "include/intarith.h"
+
 using std::list;
 using std::make_unique;
 
+/*
+ * A region of memory registered with the ring (IORING_REGISTER_BUFFERS)
+ * and carved into equally sized buffers.  The whole region is registered
+ * as a single iovec (buf_index 0), so any I/O landing inside it can be
+ * issued as READ_FIXED/WRITE_FIXED without the kernel pinning the pages
+ * again.  Buffers handed out may outlive the ring, hence the shared_ptr.
+ */
+struct ioring_fixed_buffers {
+  char *region = nullptr;
+  const size_t buffer_size;
+  const size_t num_buffers;
+  boost::lockfree::queue<unsigned> free_q;
+
+  ioring_fixed_buffers(size_t buffer_size_, size_t num_buffers_)
+    : buffer_size(p2roundup<size_t>(buffer_size_, CEPH_PAGE_SIZE)),
+      num_buffers(num_buffers_),
+      free_q(num_buffers_) {
+  }
+  ~ioring_fixed_buffers() {
+    if (region) {
+      ::munmap(region, length());
+    }
+  }
+
+  size_t length() const {
+    return buffer_size * num_buffers;
+  }
+
+  int allocate() {
+    void *p = ::mmap(nullptr, length(), PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (p == MAP_FAILED) {
+      return -errno;
+    }
+    region = static_cast<char*>(p);
+    for (unsigned i = 0; i < num_buffers; ++i) {
+      free_q.push(i);
+    }
+    return 0;
+  }
+
+  bool contains(const struct iovec& iov) const {
+    const char *base = static_cast<const char*>(iov.iov_base);
+    return region &&
+      base >= region &&
+      base + iov.iov_len <= region + length();
+  }
+  bool contains(const char *p) const {
+    return region && p >= region && p < region + length();
+  }
+};
+
+struct ioring_fixed_buffer_raw : public ceph::buffer::raw {
+  std::shared_ptr<ioring_fixed_buffers> pool;
+  const unsigned index;
+
+  ioring_fixed_buffer_raw(std::shared_ptr<ioring_fixed_buffers> p,
+			  unsigned i, unsigned l)
+    : raw(p->region + (size_t)i * p->buffer_size, l),
+      pool(std::move(p)),
+      index(i) {
+  }
+  ~ioring_fixed_buffer_raw() override {
+    // recycle the buffer; it stays registered
+    pool->free_q.push(index);
+  }
+};
+
 struct ioring_data {
   struct io_uring io_uring;
   pthread_mutex_t cq_mutex;
   pthread_mutex_t sq_mutex;
   int epoll_fd = -1;
   std::map<int, int> fixed_fds_map;
+  std::shared_ptr<ioring_fixed_buffers> fixed_buffers;
 };
 
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
@@ -58,7 +133,17 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 
   ceph_assert(fixed_fd != -1);
 
-  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+  bool fixed_buf = d->fixed_buffers &&
+    io->iov.size() == 1 &&
+    d->fixed_buffers->contains(io->iov[0]);
+
+  if (fixed_buf && io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
+    io_uring_prep_write_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			      io->iov[0].iov_len, io->offset, 0);
+  else if (fixed_buf && io->iocb.aio_lio_opcode == IO_CMD_PREADV)
+    io_uring_prep_read_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			     io->iov[0].iov_len, io->offset, 0);
+  else if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
     io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
 			 io->iov.size(), io->offset);
   else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
@@ -107,11 +192,34 @@ static void build_fixed_fds_map(struct ioring_data *d,
   }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_) :
+static void register_fixed_buffers(struct ioring_data *d,
+				   size_t buffer_size, size_t num_buffers)
+{
+  if (!buffer_size || !num_buffers)
+    return;
+
+  auto fb = std::make_shared<ioring_fixed_buffers>(buffer_size, num_buffers);
+  if (fb->allocate() < 0)
+    return;
+
+  struct iovec iov;
+  iov.iov_base = fb->region;
+  iov.iov_len = fb->length();
+  // e.g. RLIMIT_MEMLOCK too low; plain readv/writev are used then
+  if (io_uring_register_buffers(&d->io_uring, &iov, 1) < 0)
+    return;
+
+  d->fixed_buffers = std::move(fb);
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       size_t fixed_buffer_size_, size_t fixed_buffers_) :
   d(make_unique<ioring_data>()),
   iodepth(iodepth_),
   hipri(hipri_),
-  sq_thread(sq_thread_)
+  sq_thread(sq_thread_),
+  fixed_buffer_size(fixed_buffer_size_),
+  fixed_buffers(fixed_buffers_)
 {
 }
 
@@ -144,6 +252,8 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   build_fixed_fds_map(d.get(), fds);
 
+  register_fixed_buffers(d.get(), fixed_buffer_size, fixed_buffers);
+
   d->epoll_fd = epoll_create1(0);
   if (d->epoll_fd < 0) {
     ret = -errno;
@@ -163,6 +273,10 @@ int ioring_queue_t::init(std::vector<int> &fds)
 close_epoll_fd:
   close(d->epoll_fd);
 unregister_files:
+  if (d->fixed_buffers) {
+    io_uring_unregister_buffers(&d->io_uring);
+    d->fixed_buffers.reset();
+  }
   io_uring_unregister_files(&d->io_uring);
 close_ring_fd:
   io_uring_queue_exit(&d->io_uring);
@@ -175,6 +289,11 @@ void ioring_queue_t::shutdown()
   d->fixed_fds_map.clear();
   close(d->epoll_fd);
   d->epoll_fd = -1;
+  if (d->fixed_buffers) {
+    // buffers still referenced by bufferlists keep the region alive
+    io_uring_unregister_buffers(&d->io_uring);
+    d->fixed_buffers.reset();
+  }
   io_uring_unregister_files(&d->io_uring);
   io_uring_queue_exit(&d->io_uring);
 }
@@ -212,6 +331,26 @@ get_cqe:
   return events;
 }
 
+ceph::unique_leakable_ptr<ceph::buffer::raw>
+ioring_queue_t::try_create_fixed_buffer(size_t len)
+{
+  auto& fb = d->fixed_buffers;
+  if (!fb || len > fb->buffer_size)
+    return nullptr;
+
+  unsigned index;
+  if (!fb->free_q.pop(index))
+    return nullptr;
+
+  return ceph::unique_leakable_ptr<ceph::buffer::raw>(
+    new ioring_fixed_buffer_raw(fb, index, len));
+}
+
+bool ioring_queue_t::is_fixed_buffer(const char *p) const
+{
+  return d->fixed_buffers && d->fixed_buffers->contains(p);
+}
+
 bool ioring_queue_t::supported()
 {
   struct io_uring ring;
@@ -227,7 +366,8 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+			       size_t fixed_buffer_size_, size_t fixed_buffers_)
 {
   ceph_assert(0);
 }
@@ -259,6 +399,17 @@ int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   ceph_assert(0);
 }
 
+ceph::unique_leakable_ptr<ceph::buffer::raw>
+ioring_queue_t::try_create_fixed_buffer(size_t len)
+{
+  ceph_assert(0);
+}
+
+bool ioring_queue_t::is_fixed_buffer(const char *p) const
+{
+  ceph_assert(0);
+}
+
 bool ioring_queue_t::supported()
 {
   return false;
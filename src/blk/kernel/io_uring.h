@@ -19,13 +19,16 @@ struct ioring_queue_t final : public io_queue_t {
   unsigned iodepth = 0;
   bool hipri = false;
   bool sq_thread = false;
+  size_t fixed_buffer_size = 0; ///< size of a registered buffer
+  size_t fixed_buffers = 0;     ///< number of registered buffers, 0 = off
 
   typedef std::list<aio_t>::iterator aio_iter;
 
   // Returns true if arch is x86-64 and kernel supports io_uring
   static bool supported();
 
-  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_);
+  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+		 size_t fixed_buffer_size_ = 0, size_t fixed_buffers_ = 0);
   ~ioring_queue_t() final;
 
   int init(std::vector<int> &fds) final;
@@ -34,4 +37,9 @@ struct ioring_queue_t final : public io_queue_t {
   int submit_batch(aio_iter begin, aio_iter end,
                    void *priv, int *retries, int submit_retries, int initial_delay_us) final;
   int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+
+  // I/O on these buffers is issued as READ_FIXED/WRITE_FIXED
+  ceph::unique_leakable_ptr<ceph::buffer::raw>
+  try_create_fixed_buffer(size_t len) final;
+  bool is_fixed_buffer(const char *p) const final;
 };
@@ -134,14 +134,22 @@ int PMEMDevice::open(const std::string& p)
   }
 
   size_t map_len;
+  int mapped_pmem;
   addr = (char *)pmem_map_file(path.c_str(), 0,
                                devdax_device ? 0: PMEM_FILE_EXCL, O_RDWR,
-			       &map_len, NULL);
+			       &map_len, &mapped_pmem);
   if (addr == NULL) {
     derr << __func__ << " pmem_map_file failed: " << pmem_errormsg() << dendl;
     goto out_fail;
   }
   size = map_len;
+  // e.g. when bdev_type = pmem is forced onto a file that does not live on
+  // a DAX file system
+  is_pmem = mapped_pmem;
+  if (!is_pmem) {
+    dout(1) << __func__ << " " << path << " is not mapped as pmem,"
+	    << " persisting writes with msync" << dendl;
+  }
 
   // Operate as though the block size is 4 KB.  The backing file
   // blksize doesn't strictly matter except that some file systems may
@@ -302,11 +310,25 @@ int PMEMDevice::write(uint64_t off, bufferlist& bl, bool buffered, int write_hin
     auto result = dml::execute<execution_path>(dml::mem_move, dml::make_view(data, l), dml::make_view(addr + off1, l));
     ceph_assert(result.status == dml::status_code::ok);
 #else
-    pmem_memcpy_persist(addr + off1, data, l);
+    if (is_pmem) {
+      // flush each segment but fence only once, below
+      pmem_memcpy_nodrain(addr + off1, data, l);
+    } else {
+      memcpy(addr + off1, data, l);
+    }
 #endif
     len -= l;
     off1 += l;
   }
+#if !defined(HAVE_LIBDML)
+  if (is_pmem) {
+    pmem_drain();
+  } else if (pmem_msync(addr + off, bl.length()) < 0) {
+    int r = -errno;
+    derr << __func__ << " pmem_msync failed: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+#endif
   return 0;
 }
 
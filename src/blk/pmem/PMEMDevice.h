@@ -31,6 +31,8 @@ class PMEMDevice : public BlockDevice {
   char *addr; //the address of mmap
   std::string path;
   bool devdax_device = false;
+  /// mapping is real (or DAX) pmem; otherwise writes need an msync to persist
+  bool is_pmem = false;
 
   ceph::mutex debug_lock = ceph::make_mutex("PMEMDevice::debug_lock");
   interval_set<uint64_t> debug_inflight;
@@ -32,6 +32,7 @@
 
 #include <spdk/nvme.h>
 
+#include "include/buffer_raw.h"
 #include "include/intarith.h"
 #include "include/stringify.h"
 #include "include/types.h"
@@ -66,8 +67,50 @@ struct IORequest {
   uint32_t cur_seg_left = 0;
   void *inline_segs[inline_segment_num];
   void **extra_segs = nullptr;
+  // zero-copy: DMA-safe data buffer handed to the controller as is,
+  // instead of the segments above
+  char *dma_buf = nullptr;
+  uint32_t dma_off = 0;
 };
 
+/// buffer::raw in SPDK DMA-safe (hugepage) memory
+struct spdk_dma_raw : public ceph::buffer::raw {
+  spdk_dma_raw(char *p, unsigned l) : raw(p, l) {}
+  ~spdk_dma_raw() override {
+    spdk_dma_free(data);
+  }
+  static ceph::unique_leakable_ptr<ceph::buffer::raw> create(unsigned len) {
+    void *p = spdk_dma_malloc(len, CEPH_PAGE_SIZE, NULL);
+    if (!p) {
+      return nullptr;
+    }
+    return ceph::unique_leakable_ptr<ceph::buffer::raw>(
+      new spdk_dma_raw(static_cast<char*>(p), len));
+  }
+};
+
+/// whether the controller can transfer [p, p+len) without a bounce buffer.
+/// the PRP/SGL builder translates page by page, so every page of the range
+/// has to be registered with SPDK, though not physically contiguous.
+static bool is_dma_safe(const char *p, uint64_t len)
+{
+  // dword alignment is required for data buffers
+  if (((uintptr_t)p & 3) != 0) {
+    return false;
+  }
+  // a buffer may span separately registered regions, so the ends alone
+  // say nothing about the pages in between
+  for (uintptr_t page = (uintptr_t)p & CEPH_PAGE_MASK;
+       page < (uintptr_t)p + len;
+       page += CEPH_PAGE_SIZE) {
+    const char *q = std::max(p, reinterpret_cast<const char*>(page));
+    if (spdk_vtophys(q, NULL) == SPDK_VTOPHYS_ERROR) {
+      return false;
+    }
+  }
+  return true;
+}
+
 namespace bi = boost::intrusive;
 struct data_cache_buf : public bi::slist_base_hook<bi::link_mode<bi::normal_link>>
 {};
@@ -310,6 +353,21 @@ static int data_buf_next_sge(void *cb_arg, void **address, uint32_t *length)
   return 0;
 }
 
+static void dma_buf_reset_sgl(void *cb_arg, uint32_t sgl_offset)
+{
+  Task *t = static_cast<Task*>(cb_arg);
+  t->io_request.dma_off = sgl_offset;
+}
+
+static int dma_buf_next_sge(void *cb_arg, void **address, uint32_t *length)
+{
+  Task *t = static_cast<Task*>(cb_arg);
+  *address = t->io_request.dma_buf + t->io_request.dma_off;
+  *length = t->len - t->io_request.dma_off;
+  t->io_request.dma_off = t->len;
+  return 0;
+}
+
 int SharedDriverQueueData::alloc_buf_from_pool(Task *t, bool write)
 {
   uint64_t count = t->len / data_buffer_size;
@@ -379,15 +437,22 @@ void SharedDriverQueueData::_aio_handle(Task *t, IOContext *ioc)
       switch (t->command) {
         case IOCommand::WRITE_COMMAND:
         {
-          dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, true);
-          if (r < 0) {
-            goto again;
-          }
+          dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count
+                   << (t->io_request.dma_buf ? " zero-copy" : "") << dendl;
+          if (t->io_request.dma_buf) {
+            r = spdk_nvme_ns_cmd_writev(
+                ns, qpair, lba_off, lba_count, io_complete, t, 0,
+                dma_buf_reset_sgl, dma_buf_next_sge);
+          } else {
+            r = alloc_buf_from_pool(t, true);
+            if (r < 0) {
+              goto again;
+            }
 
-          r = spdk_nvme_ns_cmd_writev(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
+            r = spdk_nvme_ns_cmd_writev(
+                ns, qpair, lba_off, lba_count, io_complete, t, 0,
+                data_buf_reset_sgl, data_buf_next_sge);
+          }
           if (r < 0) {
             derr << __func__ << " failed to do write command: " << cpp_strerror(r) << dendl;
             t->ctx->nvme_task_first = t->ctx->nvme_task_last = nullptr;
@@ -399,15 +464,22 @@ void SharedDriverQueueData::_aio_handle(Task *t, IOContext *ioc)
         }
         case IOCommand::READ_COMMAND:
         {
-          dout(20) << __func__ << " read command issued " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, false);
-          if (r < 0) {
-            goto again;
-          }
+          dout(20) << __func__ << " read command issued " << lba_off << "~" << lba_count
+                   << (t->io_request.dma_buf ? " zero-copy" : "") << dendl;
+          if (t->io_request.dma_buf) {
+            r = spdk_nvme_ns_cmd_readv(
+                ns, qpair, lba_off, lba_count, io_complete, t, 0,
+                dma_buf_reset_sgl, dma_buf_next_sge);
+          } else {
+            r = alloc_buf_from_pool(t, false);
+            if (r < 0) {
+              goto again;
+            }
 
-          r = spdk_nvme_ns_cmd_readv(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
+            r = spdk_nvme_ns_cmd_readv(
+                ns, qpair, lba_off, lba_count, io_complete, t, 0,
+                data_buf_reset_sgl, data_buf_next_sge);
+          }
           if (r < 0) {
             derr << __func__ << " failed to read: " << cpp_strerror(r) << dendl;
             t->release_segs(this);
@@ -672,7 +744,9 @@ void io_complete(void *t, const struct spdk_nvme_cpl *completion)
   } else if (task->command == IOCommand::READ_COMMAND) {
     ceph_assert(!spdk_nvme_cpl_is_error(completion));
     dout(20) << __func__ << " read op successfully" << dendl;
-    task->fill_cb();
+    if (task->fill_cb) {
+      task->fill_cb();
+    }
     task->release_segs(queue);
     // read submitted by AIO
     if (!task->return_code) {
@@ -839,13 +913,20 @@ static void write_split(
   Task *t;
   // This value may need to be got from configuration later.
   uint64_t split_size = 131072; // 128KB.
+  bool zero_copy = g_conf().get_val<bool>("bluestore_spdk_zero_copy");
 
   while (remain_len > 0) {
     write_size = std::min(remain_len, split_size);
     t = new Task(dev, IOCommand::WRITE_COMMAND, off + begin, write_size);
-    // TODO: if upper layer alloc memory with known physical address,
-    // we can reduce this copy
     bl.splice(0, write_size, &t->bl);
+    // data which already lives in DMA-safe memory (e.g. read back from
+    // this device) is written without the copy into the segment pool
+    if (zero_copy && t->bl.get_num_buffers() == 1) {
+      const char *p = t->bl.front().c_str();
+      if (is_dma_safe(p, write_size)) {
+        t->io_request.dma_buf = const_cast<char*>(p);
+      }
+    }
     remain_len -= write_size;
     t->ctx = ioc;
     ioc_append_task(ioc, t);
@@ -857,7 +938,7 @@ static void make_read_tasks(
     NVMEDevice *dev,
     uint64_t aligned_off,
     IOContext *ioc, char *buf, uint64_t aligned_len, Task *primary,
-    uint64_t orig_off, uint64_t orig_len)
+    uint64_t orig_off, uint64_t orig_len, bool dma = false)
 {
   // This value may need to be got from configuration later.
   uint64_t split_size = 131072; // 128KB.
@@ -878,11 +959,16 @@ static void make_read_tasks(
 
     t->ctx = ioc;
 
-    // TODO: if upper layer alloc memory with known physical address,
-    // we can reduce this copy
-    t->fill_cb = [buf, t, tmp_off, tmp_len]  {
-      t->copy_to_buf(buf, tmp_off, tmp_len);
-    };
+    if (dma) {
+      // buf is DMA-safe and the read is aligned: the controller fills
+      // it directly
+      ceph_assert(tmp_off == 0 && tmp_len == read_size);
+      t->io_request.dma_buf = buf;
+    } else {
+      t->fill_cb = [buf, t, tmp_off, tmp_len]  {
+        t->copy_to_buf(buf, tmp_off, tmp_len);
+      };
+    }
 
     ioc_append_task(ioc, t);
     remain_orig_len -= tmp_len;
@@ -936,12 +1022,13 @@ int NVMEDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
   ceph_assert(is_valid_io(off, len));
 
   Task t(this, IOCommand::READ_COMMAND, off, len, 1);
-  bufferptr p = buffer::create_small_page_aligned(len);
+  bool dma = false;
+  bufferptr p = create_read_buffer(len, &dma);
   char *buf = p.c_str();
 
   // for sync read, need to control IOContext in itself
   IOContext read_ioc(cct, nullptr);
-  make_read_tasks(this, off, &read_ioc, buf, len, &t, off, len);
+  make_read_tasks(this, off, &read_ioc, buf, len, &t, off, len, dma);
   dout(5) << __func__ << " " << off << "~" << len << dendl;
   aio_submit(&read_ioc);
 
@@ -957,15 +1044,33 @@ int NVMEDevice::aio_read(
 {
   dout(20) << __func__ << " " << off << "~" << len << " ioc " << ioc << dendl;
   ceph_assert(is_valid_io(off, len));
-  bufferptr p = buffer::create_small_page_aligned(len);
+  bool dma = false;
+  bufferptr p = create_read_buffer(len, &dma);
+  if (dma) {
+    // DMA memory is a scarce resource; don't let the cache keep it busy
+    ioc->flags |= IOContext::FLAG_DONT_CACHE;
+  }
   pbl->append(p);
   char* buf = p.c_str();
 
-  make_read_tasks(this, off, ioc, buf, len, NULL, off, len);
+  make_read_tasks(this, off, ioc, buf, len, NULL, off, len, dma);
   dout(5) << __func__ << " " << off << "~" << len << dendl;
   return 0;
 }
 
+bufferptr NVMEDevice::create_read_buffer(uint64_t len, bool *dma)
+{
+  if (cct->_conf.get_val<bool>("bluestore_spdk_zero_copy")) {
+    if (auto raw = spdk_dma_raw::create(len); raw) {
+      *dma = true;
+      return bufferptr(std::move(raw));
+    }
+    dout(20) << __func__ << " out of DMA memory, falling back to copy" << dendl;
+  }
+  *dma = false;
+  return buffer::create_small_page_aligned(len);
+}
+
 int NVMEDevice::read_random(uint64_t off, uint64_t len, char *buf, bool buffered)
 {
   ceph_assert(len > 0);
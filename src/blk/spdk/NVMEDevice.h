@@ -47,6 +47,10 @@ class NVMEDevice : public BlockDevice {
   SharedDriverData *driver;
   std::string name;
 
+  /// a buffer to read len bytes into; *dma is set if the controller can
+  /// fill it directly
+  bufferptr create_read_buffer(uint64_t len, bool *dma);
+
  public:
   SharedDriverData *get_driver() { return driver; }
 
@@ -245,7 +245,7 @@ static int get_obj_vals(cls_method_context_t hctx,
 			const std::string& start,
 			const std::string& filter_prefix,
                         int num_entries,
-			std::map<std::string, bufferlist> *pkeys,
+			omap_batch_t *pkeys,
 			bool *pmore)
 {
   int ret = cls_cxx_map_get_vals(hctx, start, filter_prefix,
@@ -258,8 +258,8 @@ static int get_obj_vals(cls_method_context_t hctx,
     return 0;
   }
 
-  auto last_element = pkeys->crbegin();
-  if (static_cast<unsigned char>(last_element->first[0]) < BI_PREFIX_CHAR) {
+  auto last_element = pkeys->key(pkeys->size() - 1);
+  if (static_cast<unsigned char>(last_element[0]) < BI_PREFIX_CHAR) {
     /* if the first character of the last entry is less than the
      * prefix then all entries must preceed the "ugly namespace" and
      * we're done
@@ -267,8 +267,8 @@ static int get_obj_vals(cls_method_context_t hctx,
     return 0;
   }
 
-  auto first_element = pkeys->cbegin();
-  if (static_cast<unsigned char>(first_element->first[0]) > BI_PREFIX_CHAR) {
+  auto first_element = pkeys->key(0);
+  if (static_cast<unsigned char>(first_element[0]) > BI_PREFIX_CHAR) {
     /* if the first character of the first entry is after the "ugly
      * namespace" then all entries must follow the "ugly namespace"
      * then all entries do and we're done
@@ -282,24 +282,27 @@ static int get_obj_vals(cls_method_context_t hctx,
    * outside the "ugly namespace"
    */
 
-  auto comp = [](const pair<std::string, bufferlist>& l, const std::string &r) {
-		return l.first < r;
-	      };
   std::string new_start = {static_cast<char>(BI_PREFIX_CHAR + 1)};
 
-  auto lower = pkeys->lower_bound(string{static_cast<char>(BI_PREFIX_CHAR)});
-  auto upper = std::lower_bound(lower, pkeys->end(), new_start, comp);
-  pkeys->erase(lower, upper);
+  size_t lower = pkeys->lower_bound(string{static_cast<char>(BI_PREFIX_CHAR)});
+  size_t upper = pkeys->lower_bound(new_start);
+  omap_batch_t keys;
+  for (size_t i = 0; i < pkeys->size(); ++i) {
+    if (i < lower || i >= upper) {
+      keys.append(pkeys->key(i), pkeys->value(i));
+    }
+  }
+  *pkeys = std::move(keys);
 
   if (num_entries == (int)pkeys->size() || !(*pmore)) {
     return 0;
   }
 
-  if (pkeys->size() && new_start < pkeys->crbegin()->first) {
-    new_start = pkeys->rbegin()->first;
+  if (pkeys->size() && new_start < pkeys->key(pkeys->size() - 1)) {
+    new_start = pkeys->key(pkeys->size() - 1);
   }
 
-  std::map<std::string, bufferlist> new_keys;
+  omap_batch_t new_keys;
 
   /* now get some more keys */
   ret = cls_cxx_map_get_vals(hctx, new_start, filter_prefix,
@@ -308,8 +311,9 @@ static int get_obj_vals(cls_method_context_t hctx,
     return ret;
   }
 
-  pkeys->insert(std::make_move_iterator(new_keys.begin()),
-                std::make_move_iterator(new_keys.end()));
+  for (size_t i = 0; i < new_keys.size(); ++i) {
+    pkeys->append(new_keys.key(i), new_keys.value(i));
+  }
 
   return 0;
 }
@@ -439,23 +443,21 @@ static int encode_list_index_key(cls_method_context_t hctx, const cls_rgw_obj_ke
   return 0;
 }
 
-static void split_key(const string& key, list<string>& vals)
+static void split_key(std::string_view key, list<string>& vals)
 {
   size_t pos = 0;
-  const char *p = key.c_str();
   while (pos < key.size()) {
-    size_t len = strlen(p);
-    vals.push_back(p);
-    pos += len + 1;
-    p += len + 1;
+    size_t end = std::min(key.find('\0', pos), key.size());
+    vals.emplace_back(key.substr(pos, end - pos));
+    pos = end + 1;
   }
 }
 
-static std::string escape_str(const std::string& s)
+static std::string escape_str(std::string_view s)
 {
-  int len = escape_json_attr_len(s.c_str(), s.size());
+  int len = escape_json_attr_len(s.data(), s.size());
   std::string escaped(len, 0);
-  escape_json_attr(s.c_str(), s.size(), escaped.data());
+  escape_json_attr(s.data(), s.size(), escaped.data());
   return escaped;
 }
 
@@ -464,14 +466,12 @@ static std::string escape_str(const std::string& s)
  *
  * <obj name>\0[v<ver>\0i<instance id>]
  */
-static int decode_list_index_key(const string& index_key, cls_rgw_obj_key *key, uint64_t *ver)
+static int decode_list_index_key(std::string_view index_key, cls_rgw_obj_key *key, uint64_t *ver)
 {
-  size_t len = strlen(index_key.c_str());
-
   key->instance.clear();
   *ver = 0;
 
-  if (len == index_key.size()) {
+  if (index_key.find('\0') == std::string_view::npos) {
     key->name = index_key;
     return 0;
   }
@@ -609,7 +609,7 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 	 !done &&
 	 name_entry_map.size() < op.num_entries;
        ++attempt) {
-    std::map<std::string, bufferlist> keys;
+    omap_batch_t keys;
 
     // note: get_obj_vals skips past the "ugly namespace" (i.e.,
     // entries that start with the BI_PREFIX_CHAR), so no need to
@@ -625,29 +625,31 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 
     done = keys.empty();
 
-    for (auto kiter = keys.cbegin(); kiter != keys.cend(); ++kiter) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      // a view into keys; only copied where it has to outlive the batch
+      const std::string_view omap_key = keys.key(i);
       rgw_bucket_dir_entry entry;
       try {
-	const bufferlist& entrybl = kiter->second;
+	const bufferlist entrybl = keys.value(i);
 	auto eiter = entrybl.cbegin();
         decode(entry, eiter);
       } catch (ceph::buffer::error& err) {
-        CLS_LOG(1, "ERROR: %s: failed to decode entry, key=%s",
-		__func__, kiter->first.c_str());
+        CLS_LOG(1, "ERROR: %s: failed to decode entry, key=%.*s",
+		__func__, (int)omap_key.size(), omap_key.data());
         return -EINVAL;
       }
 
-      start_after_omap_key = kiter->first;
+      start_after_omap_key = omap_key;
       start_after_entry_key = entry.key;
-      CLS_LOG(20, "%s: working on key=%s len=%zu",
-	      __func__, kiter->first.c_str(), kiter->first.size());
+      CLS_LOG(20, "%s: working on key=%.*s len=%zu",
+	      __func__, (int)omap_key.size(), omap_key.data(), omap_key.size());
 
       cls_rgw_obj_key key;
       uint64_t ver;
-      int ret = decode_list_index_key(kiter->first, &key, &ver);
+      int ret = decode_list_index_key(omap_key, &key, &ver);
       if (ret < 0) {
         CLS_LOG(0, "ERROR: %s: failed to decode list index key (%s)",
-		__func__, escape_str(kiter->first).c_str());
+		__func__, escape_str(omap_key).c_str());
         continue;
       }
 
@@ -667,8 +669,8 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         start_after_omap_key = cls_rgw_after_versions(key.name);
         start_after_entry_key.set(start_after_omap_key);
 
-        kiter = keys.lower_bound(start_after_omap_key);
-        --kiter;
+        i = keys.lower_bound(start_after_omap_key);
+        --i;
         continue;
       }
 
@@ -706,8 +708,8 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 
 	  // advance past this subdirectory, but then back up one,
 	  // so the loop increment will put us in the right place
-	  kiter = keys.lower_bound(start_after_omap_key);
-	  --kiter;
+	  i = keys.lower_bound(start_after_omap_key);
+	  --i;
 
           continue;
         }
@@ -717,14 +719,14 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
       }
 
       if (name_entry_map.size() < op.num_entries &&
-	  kiter->first != prev_omap_key) {
-        name_entry_map[kiter->first] = entry;
-	prev_omap_key = kiter->first;
+	  omap_key != prev_omap_key) {
+        name_entry_map[std::string(omap_key)] = entry;
+	prev_omap_key = omap_key;
 	CLS_LOG(20, "%s: got object entry %s[%s] num entries=%d",
 		__func__, key.name.c_str(), key.instance.c_str(),
 		int(name_entry_map.size()));
       }
-    } // for (auto kiter...
+    } // for (size_t i...
   } // for (int attempt...
 
   ret.is_truncated = more && !done;
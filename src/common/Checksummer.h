@@ -7,6 +7,7 @@
 #include "include/buffer.h"
 #include "include/byteorder.h"
 #include "include/ceph_assert.h"
+#include "include/crc32c.h"
 
 #include "xxHash/xxhash.h"
 
@@ -90,6 +91,19 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t block_size,
+      size_t nblocks,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < nblocks; ++i, data += block_size) {
+	out[i] = ceph_crc32c(init_value, (const unsigned char*)data,
+			     block_size);
+      }
+    }
   };
 
   struct crc32c_16 {
@@ -111,6 +125,19 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t block_size,
+      size_t nblocks,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < nblocks; ++i, data += block_size) {
+	out[i] = ceph_crc32c(init_value, (const unsigned char*)data,
+			     block_size) & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -132,6 +159,19 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t block_size,
+      size_t nblocks,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < nblocks; ++i, data += block_size) {
+	out[i] = ceph_crc32c(init_value, (const unsigned char*)data,
+			     block_size) & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -161,6 +201,18 @@ public:
       }
       return XXH32_digest(state);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t block_size,
+      size_t nblocks,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < nblocks; ++i, data += block_size) {
+	out[i] = XXH32(data, block_size, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -190,6 +242,18 @@ public:
       }
       return XXH64_digest(state);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t block_size,
+      size_t nblocks,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < nblocks; ++i, data += block_size) {
+	out[i] = XXH64(data, block_size, init_value);
+      }
+    }
   };
 
   template<class Alg>
@@ -225,9 +289,25 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
+    typename Alg::init_value_t v[batch_blocks];
+    while (blocks > 0) {
+      // hash whole blocks straight out of the current buffer::ptr; only
+      // blocks straddling a ptr boundary go through the iterator path.
+      const char *data;
+      size_t n = contiguous_blocks(p, csum_block_size,
+				   std::min(blocks, batch_blocks), &data);
+      if (n == 0) {
+	*pv = Alg::calc(state, init_value, csum_block_size, p);
+	++pv;
+	--blocks;
+	continue;
+      }
+      Alg::calc_blocks(state, init_value, csum_block_size, n, data, v);
+      for (size_t i = 0; i < n; ++i, ++pv) {
+	*pv = v[i];
+      }
+      p += n * csum_block_size;
+      blocks -= n;
     }
     Alg::fini(&state);
     return 0;
@@ -253,22 +333,50 @@ public:
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
-    while (length > 0) {
-      typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    size_t blocks = length / csum_block_size;
+    typename Alg::init_value_t v[batch_blocks];
+    while (blocks > 0) {
+      const char *data;
+      size_t n = contiguous_blocks(p, csum_block_size,
+				   std::min(blocks, batch_blocks), &data);
+      if (n == 0) {
+	v[0] = Alg::calc(state, -1, csum_block_size, p);
+	n = 1;
+      } else {
+	Alg::calc_blocks(state, -1, csum_block_size, n, data, v);
+	p += n * csum_block_size;
+      }
+      for (size_t i = 0; i < n; ++i) {
+	if (*pv != v[i]) {
+	  if (bad_csum) {
+	    *bad_csum = v[i];
+	  }
+	  Alg::fini(&state);
+	  return pos;
 	}
-	Alg::fini(&state);
-	return pos;
+	++pv;
+	pos += csum_block_size;
       }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
+      blocks -= n;
     }
     Alg::fini(&state);
     return -1;  // no errors
   }
+
+private:
+  /// max csum blocks handed to Alg::calc_blocks() at once
+  static constexpr size_t batch_blocks = 16;
+
+  /// number of whole csum blocks readable contiguously at p, up to max
+  static size_t contiguous_blocks(
+    const ceph::buffer::list::const_iterator& p,
+    size_t csum_block_size,
+    size_t max,
+    const char **data) {
+    ceph::buffer::list::const_iterator q = p;
+    size_t l = q.get_ptr_and_advance(max * csum_block_size, data);
+    return l / csum_block_size;
+  }
 };
 
 #endif
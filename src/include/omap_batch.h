@@ -0,0 +1,136 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OMAP_BATCH_H
+#define CEPH_OMAP_BATCH_H
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/encoding.h"
+
+/**
+ * omap_batch_t - a sorted run of omap entries read in one go
+ *
+ * Keys and values are packed back to back in a single buffer, laid out
+ * exactly like the entries of an encoded std::map<std::string,
+ * ceph::buffer::list>.  A batch therefore encodes (and decodes) to the
+ * same bytes as such a map, but it is filled and consumed without a
+ * std::string, a bufferlist and a map node per entry: keys are handed out
+ * as string_views into the buffer and values share it.
+ */
+class omap_batch_t {
+  struct entry_t {
+    uint32_t key_off;  ///< offset of the key bytes in data
+    uint32_t key_len;
+    uint32_t val_len;  ///< value bytes follow the key and a length field
+  };
+
+  /// u32 key length, key, u32 value length, value; for every entry
+  mutable ceph::buffer::list data;
+  std::vector<entry_t> entries;
+
+  const char *c_str() const {
+    // make (and keep) the buffer contiguous so keys can be viewed in place
+    return data.c_str();
+  }
+
+public:
+  size_t size() const {
+    return entries.size();
+  }
+  bool empty() const {
+    return entries.empty();
+  }
+  /// bytes taken by keys and values (and their lengths)
+  unsigned length() const {
+    return data.length();
+  }
+  void clear() {
+    data.clear();
+    entries.clear();
+  }
+
+  std::string_view key(size_t i) const {
+    const auto& e = entries[i];
+    return std::string_view(c_str() + e.key_off, e.key_len);
+  }
+  /// shares the batch buffer, the value bytes are not copied
+  ceph::buffer::list value(size_t i) const {
+    const auto& e = entries[i];
+    ceph::buffer::list bl;
+    bl.substr_of(data, e.key_off + e.key_len + sizeof(uint32_t), e.val_len);
+    return bl;
+  }
+
+  /// index of the first entry whose key is not less than k
+  size_t lower_bound(std::string_view k) const {
+    auto p = std::partition_point(
+      entries.begin(), entries.end(),
+      [this, k](const entry_t& e) {
+	return std::string_view(c_str() + e.key_off, e.key_len) < k;
+      });
+    return p - entries.begin();
+  }
+
+  /// keys must be appended in ascending order
+  void append(std::string_view k, std::string_view v) {
+    using ceph::encode;
+    encode(static_cast<uint32_t>(k.size()), data);
+    entries.push_back(entry_t{data.length(), static_cast<uint32_t>(k.size()),
+			      static_cast<uint32_t>(v.size())});
+    data.append(k.data(), k.size());
+    encode(static_cast<uint32_t>(v.size()), data);
+    data.append(v.data(), v.size());
+  }
+  void append(std::string_view k, const ceph::buffer::list& v) {
+    using ceph::encode;
+    encode(static_cast<uint32_t>(k.size()), data);
+    entries.push_back(entry_t{data.length(), static_cast<uint32_t>(k.size()),
+			      static_cast<uint32_t>(v.length())});
+    data.append(k.data(), k.size());
+    encode(static_cast<uint32_t>(v.length()), data);
+    data.append(v);
+  }
+
+  void encode(ceph::buffer::list& bl) const {
+    using ceph::encode;
+    encode(static_cast<uint32_t>(entries.size()), bl);
+    bl.append(data);
+  }
+  void decode(ceph::buffer::list::const_iterator& p) {
+    using ceph::decode;
+    clear();
+    uint32_t n;
+    decode(n, p);
+    entries.reserve(n);
+    // index the entries first, then take the whole run in one (shallow) copy
+    auto start = p;
+    uint32_t off = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      entry_t e;
+      decode(e.key_len, p);
+      e.key_off = off + sizeof(uint32_t);
+      p += e.key_len;
+      decode(e.val_len, p);
+      p += e.val_len;
+      off = e.key_off + e.key_len + sizeof(uint32_t) + e.val_len;
+      entries.push_back(e);
+    }
+    start.copy(off, data);
+  }
+};
+WRITE_CLASS_ENCODER(omap_batch_t)
+
+#endif
@@ -10,6 +10,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
 #include "common/Formatter.h"
@@ -196,6 +197,21 @@ public:
 		  ceph::buffer::list *value) {
     return get(prefix, std::string(key, keylen), value);
   }
+  /// Retrieve several keys with one batched lookup.  On return
+  /// (*values)[i] holds the value of keys[i] and (*rs)[i] is 0, or
+  /// -ENOENT if the key does not exist.
+  virtual void multi_get(
+    const std::string &prefix,                  ///< [in] prefix or CF name
+    const std::vector<std::string> &keys,       ///< [in] keys
+    std::vector<ceph::buffer::list> *values,    ///< [out] values
+    std::vector<int> *rs) {                     ///< [out] per key result
+    values->clear();
+    values->resize(keys.size());
+    rs->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      (*rs)[i] = get(prefix, keys[i], &(*values)[i]);
+    }
+  }
 
   // This superclass is used both by kv iterators *and* by the ObjectMap
   // omap iterator.  The class hierarchies are unfortunately tied together
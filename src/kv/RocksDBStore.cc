@@ -468,7 +468,9 @@ std::shared_ptr<rocksdb::Cache> RocksDBStore::create_block_cache(
   std::shared_ptr<rocksdb::Cache> cache;
   auto shard_bits = cct->_conf->rocksdb_cache_shard_bits;
   if (cache_type == "binned_lru") {
-    cache = rocksdb_cache::NewBinnedLRUCache(cct, cache_size, shard_bits, false, cache_prio_high);
+    cache = rocksdb_cache::NewBinnedLRUCache(
+      cct, cache_size, shard_bits, false, cache_prio_high,
+      cct->_conf.get_val<double>("rocksdb_cache_probation_ratio"));
   } else if (cache_type == "lru") {
     cache = rocksdb::NewLRUCache(cache_size, shard_bits);
   } else if (cache_type == "clock") {
@@ -1894,40 +1896,77 @@ int RocksDBStore::get(
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
-  rocksdb::PinnableSlice value;
+  std::vector<string> kv(keys.begin(), keys.end());
+  std::vector<bufferlist> values;
+  std::vector<int> rs;
+  multi_get(prefix, kv, &values, &rs);
+  for (size_t i = 0; i < kv.size(); ++i) {
+    if (rs[i] == 0) {
+      (*out)[kv[i]].claim_append(values[i]);
+    }
+  }
+  return 0;
+}
+
+void RocksDBStore::multi_get(
+    const string &prefix,
+    const std::vector<string> &keys,
+    std::vector<bufferlist> *values,
+    std::vector<int> *rs)
+{
   utime_t start = ceph_clock_now();
+  size_t n = keys.size();
+  values->clear();
+  values->resize(n);
+  rs->assign(n, -ENOENT);
+  if (n == 0) {
+    return;
+  }
+
+  // a sharded prefix spreads its keys over several column families and
+  // MultiGet takes a single one, so issue one batch per column family.
+  std::vector<string> combined;
+  std::vector<rocksdb::Slice> slices;
+  slices.reserve(n);
+  std::map<rocksdb::ColumnFamilyHandle*, std::vector<size_t>> batches;
   if (cf_handles.count(prefix) > 0) {
-    for (auto& key : keys) {
-      auto cf_handle = get_cf_handle(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    cf_handle,
-			    rocksdb::Slice(key),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
-      }
-      value.Reset();
+    for (size_t i = 0; i < n; ++i) {
+      slices.emplace_back(keys[i]);
+      batches[get_cf_handle(prefix, keys[i])].push_back(i);
     }
   } else {
-    for (auto& key : keys) {
-      string k = combine_strings(prefix, key);
-      auto status = db->Get(rocksdb::ReadOptions(),
-			    default_cf,
-			    rocksdb::Slice(k),
-			    &value);
-      if (status.ok()) {
-	(*out)[key].append(value.data(), value.size());
-      } else if (status.IsIOError()) {
-	ceph_abort_msg(status.getState());
+    combined.reserve(n);
+    auto& batch = batches[default_cf];
+    for (size_t i = 0; i < n; ++i) {
+      combined.push_back(combine_strings(prefix, keys[i]));
+      slices.emplace_back(combined.back());
+      batch.push_back(i);
+    }
+  }
+
+  std::vector<rocksdb::Slice> batch_keys;
+  std::vector<rocksdb::Status> statuses;
+  for (auto& [cf, idx] : batches) {
+    batch_keys.clear();
+    for (auto i : idx) {
+      batch_keys.push_back(slices[i]);
+    }
+    std::vector<rocksdb::PinnableSlice> batch_values(idx.size());
+    statuses.assign(idx.size(), rocksdb::Status());
+    db->MultiGet(rocksdb::ReadOptions(), cf, idx.size(),
+		 batch_keys.data(), batch_values.data(), statuses.data());
+    for (size_t j = 0; j < idx.size(); ++j) {
+      if (statuses[j].ok()) {
+	(*values)[idx[j]].append(batch_values[j].data(),
+				 batch_values[j].size());
+	(*rs)[idx[j]] = 0;
+      } else if (!statuses[j].IsNotFound()) {
+	ceph_abort_msg(statuses[j].getState());
       }
-      value.Reset();
     }
   }
   utime_t lat = ceph_clock_now() - start;
   logger->tinc(l_rocksdb_get_latency, lat);
-  return 0;
 }
 
 int RocksDBStore::get(
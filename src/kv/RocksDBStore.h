@@ -358,6 +358,11 @@ public:
     const char *key,
     size_t keylen,
     ceph::bufferlist *out) override;
+  void multi_get(
+    const std::string &prefix,
+    const std::vector<std::string> &keys,
+    std::vector<ceph::bufferlist> *values,
+    std::vector<int> *rs) override;
 
 
   class RocksDBWholeSpaceIteratorImpl :
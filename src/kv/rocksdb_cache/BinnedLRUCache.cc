@@ -102,13 +102,17 @@ void BinnedLRUHandleTable::Resize() {
 }
 
 BinnedLRUCacheShard::BinnedLRUCacheShard(CephContext *c, size_t capacity, bool strict_capacity_limit,
-                             double high_pri_pool_ratio)
+                             double high_pri_pool_ratio, double probation_ratio)
     : cct(c),
       capacity_(0),
       high_pri_pool_usage_(0),
       strict_capacity_limit_(strict_capacity_limit),
       high_pri_pool_ratio_(high_pri_pool_ratio),
       high_pri_pool_capacity_(0),
+      probation_ratio_(probation_ratio),
+      probation_capacity_(0),
+      probation_usage_(0),
+      ghost_usage_(0),
       usage_(0),
       lru_usage_(0),
       age_bins(1) {
@@ -117,6 +121,7 @@ BinnedLRUCacheShard::BinnedLRUCacheShard(CephContext *c, size_t capacity, bool s
   lru_.next = &lru_;
   lru_.prev = &lru_;
   lru_low_pri_ = &lru_;
+  lru_probation_ = &lru_;
   SetCapacity(capacity);
 }
 
@@ -197,16 +202,34 @@ size_t BinnedLRUCacheShard::GetHighPriPoolUsage() const {
   return high_pri_pool_usage_;
 }
 
+double BinnedLRUCacheShard::GetProbationRatio() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return probation_ratio_;
+}
+
+size_t BinnedLRUCacheShard::GetProbationUsage() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return probation_usage_;
+}
+
 void BinnedLRUCacheShard::LRU_Remove(BinnedLRUHandle* e) {
   ceph_assert(e->next != nullptr);
   ceph_assert(e->prev != nullptr);
   if (lru_low_pri_ == e) {
     lru_low_pri_ = e->prev;
   }
+  if (lru_probation_ == e) {
+    lru_probation_ = e->prev;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
   e->prev = e->next = nullptr;
   lru_usage_ -= e->charge;
+  if (e->InProbation()) {
+    ceph_assert(probation_usage_ >= e->charge);
+    probation_usage_ -= e->charge;
+    e->SetInProbation(false);
+  }
   if (e->InHighPriPool()) {
     ceph_assert(high_pri_pool_usage_ >= e->charge);
     high_pri_pool_usage_ -= e->charge;
@@ -230,6 +253,24 @@ void BinnedLRUCacheShard::LRU_Insert(BinnedLRUHandle* e) {
     e->SetInHighPriPool(true);
     high_pri_pool_usage_ += e->charge;
     MaintainPoolSize();
+  } else if (probation_capacity_ > 0 && !e->HasHit() && !GhostTake(e->hash)) {
+    // Not hit since it was inserted: put "e" at the head of the probation
+    // segment, behind everything in the main low-pri pool, so that a scan
+    // only churns through probation.  Account it in the oldest age bin so
+    // the PriorityCache does not mistake it for hot data either.
+    e->next = lru_probation_->next;
+    e->prev = lru_probation_;
+    e->prev->next = e;
+    e->next->prev = e;
+    e->SetInHighPriPool(false);
+    e->SetInProbation(true);
+    if (lru_low_pri_ == lru_probation_) {
+      lru_low_pri_ = e;
+    }
+    lru_probation_ = e;
+    probation_usage_ += e->charge;
+    e->age_bin = age_bins.back();
+    *(e->age_bin) += e->charge;
   } else {
     // Insert "e" to the head of low-pri pool. Note that when
     // high_pri_pool_ratio is 0, head of low-pri pool is also head of LRU list.
@@ -273,8 +314,17 @@ void BinnedLRUCacheShard::EvictFromLRU(size_t charge,
                                  BinnedLRUHandle*& deleted) {
   while (usage_ + charge > capacity_ && lru_.next != &lru_) {
     BinnedLRUHandle* old = lru_.next;
+    // While probation is within its share, evict from the main low-pri
+    // pool instead so that new entries get a chance to be hit again.
+    if (probation_usage_ <= probation_capacity_ &&
+        lru_low_pri_ != lru_probation_) {
+      old = lru_probation_->next;
+    }
     ceph_assert(old->InCache());
     ceph_assert(old->refs == 1);  // LRU list contains elements which may be evicted
+    if (old->InProbation()) {
+      GhostInsert(old);
+    }
     LRU_Remove(old);
     table_.Remove(old->key(), old->hash);
     old->SetInCache(false);
@@ -286,12 +336,43 @@ void BinnedLRUCacheShard::EvictFromLRU(size_t charge,
   }
 }
 
+void BinnedLRUCacheShard::GhostInsert(BinnedLRUHandle* e) {
+  ghost_.emplace_back(e->hash, e->charge);
+  ghost_hashes_.insert(e->hash);
+  ghost_usage_ += e->charge;
+  GhostTrim();
+}
+
+void BinnedLRUCacheShard::GhostTrim() {
+  while (ghost_usage_ > capacity_ / 2 && !ghost_.empty()) {
+    auto [hash, charge] = ghost_.front();
+    ghost_.pop_front();
+    ghost_usage_ -= charge;
+    // may already have been taken by GhostTake()
+    auto p = ghost_hashes_.find(hash);
+    if (p != ghost_hashes_.end()) {
+      ghost_hashes_.erase(p);
+    }
+  }
+}
+
+bool BinnedLRUCacheShard::GhostTake(uint32_t hash) {
+  auto p = ghost_hashes_.find(hash);
+  if (p == ghost_hashes_.end()) {
+    return false;
+  }
+  ghost_hashes_.erase(p);
+  return true;
+}
+
 void BinnedLRUCacheShard::SetCapacity(size_t capacity) {
   BinnedLRUHandle* deleted = nullptr;
   {
     std::lock_guard<std::mutex> l(mutex_);
     capacity_ = capacity;
     high_pri_pool_capacity_ = capacity_ * high_pri_pool_ratio_;
+    probation_capacity_ = capacity_ * probation_ratio_;
+    GhostTrim();
     EvictFromLRU(0, deleted);
   }
   // we free the entries here outside of mutex for
@@ -335,6 +416,12 @@ void BinnedLRUCacheShard::SetHighPriPoolRatio(double high_pri_pool_ratio) {
   MaintainPoolSize();
 }
 
+void BinnedLRUCacheShard::SetProbationRatio(double probation_ratio) {
+  std::lock_guard<std::mutex> l(mutex_);
+  probation_ratio_ = probation_ratio;
+  probation_capacity_ = capacity_ * probation_ratio_;
+}
+
 bool BinnedLRUCacheShard::Release(rocksdb::Cache::Handle* handle, bool force_erase) {
   if (handle == nullptr) {
     return false;
@@ -505,8 +592,9 @@ std::string BinnedLRUCacheShard::GetPrintableOptions() const {
   char buffer[kBufferSize];
   {
     std::lock_guard<std::mutex> l(mutex_);
-    snprintf(buffer, kBufferSize, "    high_pri_pool_ratio: %.3lf\n",
-             high_pri_pool_ratio_);
+    snprintf(buffer, kBufferSize, "    high_pri_pool_ratio: %.3lf\n"
+             "    probation_ratio: %.3lf\n",
+             high_pri_pool_ratio_, probation_ratio_);
   }
   return std::string(buffer);
 }
@@ -521,7 +609,8 @@ BinnedLRUCache::BinnedLRUCache(CephContext *c,
                                size_t capacity, 
                                int num_shard_bits,
                                bool strict_capacity_limit, 
-                               double high_pri_pool_ratio)
+                               double high_pri_pool_ratio,
+                               double probation_ratio)
     : ShardedCache(capacity, num_shard_bits, strict_capacity_limit), cct(c) {
   num_shards_ = 1 << num_shard_bits;
   // TODO: Switch over to use mempool
@@ -534,7 +623,8 @@ BinnedLRUCache::BinnedLRUCache(CephContext *c,
   size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
   for (int i = 0; i < num_shards_; i++) {
     new (&shards_[i])
-        BinnedLRUCacheShard(c, per_shard, strict_capacity_limit, high_pri_pool_ratio);
+        BinnedLRUCacheShard(c, per_shard, strict_capacity_limit, high_pri_pool_ratio,
+                            probation_ratio);
   }
 }
 
@@ -610,6 +700,20 @@ size_t BinnedLRUCache::GetHighPriPoolUsage() const {
   return usage;
 }
 
+void BinnedLRUCache::SetProbationRatio(double probation_ratio) {
+  for (int i = 0; i < num_shards_; i++) {
+    shards_[i].SetProbationRatio(probation_ratio);
+  }
+}
+
+size_t BinnedLRUCache::GetProbationUsage() const {
+  size_t usage = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    usage += shards_[s].GetProbationUsage();
+  }
+  return usage;
+}
+
 // PriCache
 
 int64_t BinnedLRUCache::request_cache_bytes(PriorityCache::Priority pri, uint64_t total_cache) const
@@ -703,7 +807,8 @@ std::shared_ptr<rocksdb::Cache> NewBinnedLRUCache(
     size_t capacity,
     int num_shard_bits,
     bool strict_capacity_limit,
-    double high_pri_pool_ratio) {
+    double high_pri_pool_ratio,
+    double probation_ratio) {
   if (num_shard_bits >= 20) {
     return nullptr;  // the cache cannot be sharded into too many fine pieces
   }
@@ -711,11 +816,16 @@ std::shared_ptr<rocksdb::Cache> NewBinnedLRUCache(
     // invalid high_pri_pool_ratio
     return nullptr;
   }
+  if (probation_ratio < 0.0 || probation_ratio > 1.0) {
+    // invalid probation_ratio
+    return nullptr;
+  }
   if (num_shard_bits < 0) {
     num_shard_bits = GetDefaultCacheShardBits(capacity);
   }
   return std::make_shared<BinnedLRUCache>(
-      c, capacity, num_shard_bits, strict_capacity_limit, high_pri_pool_ratio);
+      c, capacity, num_shard_bits, strict_capacity_limit, high_pri_pool_ratio,
+      probation_ratio);
 }
 
 }  // namespace rocksdb_cache
@@ -10,8 +10,10 @@
 #ifndef ROCKSDB_BINNED_LRU_CACHE
 #define ROCKSDB_BINNED_LRU_CACHE
 
+#include <deque>
 #include <string>
 #include <mutex>
+#include <unordered_set>
 #include <boost/circular_buffer.hpp>
 
 #include "ShardedCache.h"
@@ -46,13 +48,21 @@ namespace rocksdb_cache {
 // that any successful BinnedLRUCacheShard::Lookup/BinnedLRUCacheShard::Insert have a
 // matching
 // RUCache::Release (to move into state 2) or BinnedLRUCacheShard::Erase (for state 3)
+//
+// With a non-zero probation_ratio the low-pri pool is scan resistant in
+// the style of 2Q: entries that have not been hit yet enter a probation
+// segment at the cold end of the LRU list instead of its head, and are
+// only moved into the main pool once they are looked up again.  Hashes
+// of entries evicted from probation are remembered in a ghost list; if
+// such an entry is inserted again it goes straight into the main pool.
 
 std::shared_ptr<rocksdb::Cache> NewBinnedLRUCache(
     CephContext *c,
     size_t capacity,
     int num_shard_bits = -1,
     bool strict_capacity_limit = false,
-    double high_pri_pool_ratio = 0.0);
+    double high_pri_pool_ratio = 0.0,
+    double probation_ratio = 0.0);
 
 struct BinnedLRUHandle {
   std::shared_ptr<uint64_t> age_bin;
@@ -70,6 +80,8 @@ struct BinnedLRUHandle {
   //   in_cache:    whether this entry is referenced by the hash table.
   //   is_high_pri: whether this entry is high priority entry.
   //   in_high_pri_pool: whether this entry is in high-pri pool.
+  //   has_hit:     whether this entry has been looked up since insertion.
+  //   in_probation: whether this entry is in the probation segment.
   char flags;
 
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
@@ -90,6 +102,7 @@ struct BinnedLRUHandle {
   bool IsHighPri() { return flags & 2; }
   bool InHighPriPool() { return flags & 4; }
   bool HasHit() { return flags & 8; }
+  bool InProbation() { return flags & 16; }
 
   void SetInCache(bool in_cache) {
     if (in_cache) {
@@ -117,6 +130,14 @@ struct BinnedLRUHandle {
 
   void SetHit() { flags |= 8; }
 
+  void SetInProbation(bool in_probation) {
+    if (in_probation) {
+      flags |= 16;
+    } else {
+      flags &= ~16;
+    }
+  }
+
   void Free() {
     ceph_assert((refs == 1 && InCache()) || (refs == 0 && !InCache()));
     if (deleter) {
@@ -173,7 +194,7 @@ class BinnedLRUHandleTable {
 class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
  public:
   BinnedLRUCacheShard(CephContext *c, size_t capacity, bool strict_capacity_limit,
-                double high_pri_pool_ratio);
+                double high_pri_pool_ratio, double probation_ratio = 0.0);
   virtual ~BinnedLRUCacheShard();
 
   // Separate from constructor so caller can easily make an array of BinnedLRUCache
@@ -187,6 +208,9 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // Set percentage of capacity reserved for high-pri cache entries.
   void SetHighPriPoolRatio(double high_pri_pool_ratio);
 
+  // Set percentage of capacity kept for entries on probation.
+  void SetProbationRatio(double probation_ratio);
+
   // Like Cache methods, but with an extra "hash" parameter.
   virtual rocksdb::Status Insert(const rocksdb::Slice& key, uint32_t hash, void* value,
                         size_t charge,
@@ -231,6 +255,12 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // Retrieves high pri pool usage
   size_t GetHighPriPoolUsage() const;
 
+  //  Retrieves probation ratio
+  double GetProbationRatio() const;
+
+  // Retrieves probation segment usage
+  size_t GetProbationUsage() const;
+
   // Rotate the bins
   void shift_bins();
 
@@ -262,6 +292,13 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // holding the mutex_
   void EvictFromLRU(size_t charge, BinnedLRUHandle*& deleted);
 
+  // Remember the hash of an entry evicted from probation, forgetting the
+  // oldest ones once they add up to more than half of the capacity.
+  void GhostInsert(BinnedLRUHandle* e);
+  void GhostTrim();
+  // Return true (and forget it) if hash was recently evicted from probation.
+  bool GhostTake(uint32_t hash);
+
   void FreeDeleted(BinnedLRUHandle* deleted) {
     while (deleted) {
       auto* entry = deleted;
@@ -294,6 +331,23 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // Pointer to head of low-pri pool in LRU list.
   BinnedLRUHandle* lru_low_pri_;
 
+  // Ratio of capacity kept for entries on probation, and the
+  // corresponding size.
+  double probation_ratio_;
+  size_t probation_capacity_;
+
+  // Pointer to head of the probation segment in LRU list. The segment is
+  // the oldest part of the low-pri pool, up to and including this entry.
+  BinnedLRUHandle* lru_probation_;
+
+  // Memory size for entries in the probation segment.
+  size_t probation_usage_;
+
+  // Hashes (and charges) of entries recently evicted from probation.
+  std::deque<std::pair<uint32_t, size_t>> ghost_;
+  std::unordered_multiset<uint32_t> ghost_hashes_;
+  size_t ghost_usage_;
+
   // ------------^^^^^^^^^^^^^-----------
   // Not frequently modified data members
   // ------------------------------------
@@ -325,7 +379,8 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
 class BinnedLRUCache : public ShardedCache {
  public:
   BinnedLRUCache(CephContext *c, size_t capacity, int num_shard_bits,
-      bool strict_capacity_limit, double high_pri_pool_ratio);
+      bool strict_capacity_limit, double high_pri_pool_ratio,
+      double probation_ratio = 0.0);
   virtual ~BinnedLRUCache();
   virtual const char* Name() const override { return "BinnedLRUCache"; }
   virtual CacheShard* GetShard(int shard) override;
@@ -345,6 +400,10 @@ class BinnedLRUCache : public ShardedCache {
   double GetHighPriPoolRatio() const;
   // Retrieves high pri pool usage
   size_t GetHighPriPoolUsage() const;
+  // Sets the probation ratio
+  void SetProbationRatio(double probation_ratio);
+  // Retrieves probation usage
+  size_t GetProbationUsage() const;
 
   // PriorityCache
   virtual int64_t request_cache_bytes(
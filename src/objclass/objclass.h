@@ -11,6 +11,7 @@
 #include "common/hobject.h"
 #include "common/ceph_time.h"
 #include "common/ceph_releases.h"
+#include "include/omap_batch.h"
 #include "include/rados/objclass.h"
 
 struct obj_list_watch_response_t;
@@ -113,6 +114,13 @@ extern int cls_cxx_map_get_vals(cls_method_context_t hctx,
                                 uint64_t max_to_get,
                                 std::map<std::string, ceph::buffer::list> *vals,
                                 bool *more);
+/* same as above, but without a std::string and bufferlist per entry */
+extern int cls_cxx_map_get_vals(cls_method_context_t hctx,
+                                const std::string& start_after,
+                                const std::string& filter_prefix,
+                                uint64_t max_to_get,
+                                omap_batch_t *vals,
+                                bool *more);
 extern int cls_cxx_map_get_val(cls_method_context_t hctx, const std::string &key,
                                bufferlist *outbl);
 extern int cls_cxx_map_get_vals_by_keys(cls_method_context_t hctx,
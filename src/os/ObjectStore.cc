@@ -117,3 +117,34 @@ int ObjectStore::get_ideal_list_max()
 {
   return cct->_conf->osd_objectstore_ideal_list_max;
 }
+
+int ObjectStore::omap_get_range(
+  CollectionHandle &c,
+  const ghobject_t &oid,
+  omap_iter_seek_t start_from,
+  std::string_view filter_prefix,
+  uint64_t max_entries,
+  uint64_t max_bytes,
+  omap_batch_t *out)
+{
+  out->clear();
+  bool truncated = false;
+  int r = omap_iterate(
+    c, oid, std::move(start_from),
+    [out, &truncated, filter_prefix, max_entries, max_bytes]
+    (std::string_view key, std::string_view value) {
+      if (key.substr(0, filter_prefix.size()) != filter_prefix) {
+	return omap_iter_ret_t::STOP;
+      }
+      if (out->size() >= max_entries || out->length() >= max_bytes) {
+	truncated = true;
+	return omap_iter_ret_t::STOP;
+      }
+      out->append(key, value);
+      return omap_iter_ret_t::NEXT;
+    });
+  if (r < 0) {
+    return r;
+  }
+  return truncated;
+}
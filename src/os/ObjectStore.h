@@ -18,6 +18,7 @@
 #include "include/common_fwd.h"
 #include "include/Context.h"
 #include "include/interval_set.h"
+#include "include/omap_batch.h"
 #include "include/stringify.h"
 #include "include/types.h"
 
@@ -308,6 +309,15 @@ public:
   virtual uint64_t get_min_alloc_size() const {
     return 0;
   }
+  /**
+   * true if a transaction overwriting this many bytes in whole
+   * min_alloc_size units would currently be admitted by queue_transactions()
+   * without waiting on a throttle.  This is only a hint: concurrent
+   * submitters may take the room first.
+   */
+  virtual bool can_queue_write_nowait(uint64_t bytes) {
+    return false;
+  }
 
   /// enumerate hardware devices (by 'devname', e.g., 'sda' as in /sys/block/sda)
   virtual int get_devices(std::set<std::string> *devls) {
@@ -443,6 +453,18 @@ public:
    * @returns true if object exists, false otherwise
    */
   virtual bool exists(CollectionHandle& c, const ghobject_t& oid) = 0;
+  /**
+   * prefetch -- hint that objects are about to be read
+   *
+   * Lets the backend batch the metadata lookups that the following
+   * stat/getattr(s)/omap calls on these objects would otherwise issue
+   * one at a time.  Purely advisory.
+   *
+   * @param cid collection for objects
+   * @param oids objects, in the order they are going to be read
+   */
+  virtual void prefetch(CollectionHandle& c,
+			const std::vector<ghobject_t>& oids) {}
   /**
    * set_collection_opts -- std::set pool options for a collectioninformation for an object
    *
@@ -789,6 +811,28 @@ public:
                                   std::string_view)> visitor
   ) = 0;
 
+  /**
+   * Read a run of omap entries in one go
+   *
+   * Fills out with the entries from `start_from` on, up to the first key
+   * that does not start with `filter_prefix`, or until `max_entries`
+   * entries or `max_bytes` bytes have been read.  Built on omap_iterate()
+   * by default.
+   *
+   * @return  - error code (negative value) on failure,
+   *          - positive value when max_entries or max_bytes cut the
+   *            run short and more matching entries may follow,
+   *          - 0 otherwise.
+   */
+  virtual int omap_get_range(
+    CollectionHandle &c,
+    const ghobject_t &oid,
+    omap_iter_seek_t start_from,
+    std::string_view filter_prefix,
+    uint64_t max_entries,
+    uint64_t max_bytes,
+    omap_batch_t *out);
+
   virtual int flush_journal() { return -EOPNOTSUPP; }
 
   virtual int dump_journal(std::ostream& out) { return -EOPNOTSUPP; }
@@ -12,6 +12,7 @@
 #include "HybridAllocator.h"
 #include "common/debug.h"
 #include "common/admin_socket.h"
+#include <thread>
 
 #define dout_subsys ceph_subsys_bluestore
 using TOPNSPC::common::cmd_getval;
@@ -34,6 +35,246 @@ Allocator::Allocator(std::string_view name,
 Allocator::~Allocator()
 {}
 
+/*
+ * Front end which keeps small per-thread batches ("magazines") of single
+ * allocation unit extents in front of another allocator.  Allocations and
+ * releases of exactly one unit are served from the caller's magazine under
+ * its own lock.  A magazine that fills up on release is handed over as a
+ * whole to a shared depot, and a magazine that runs empty on allocation
+ * takes a full one from the depot before going to the wrapped allocator.
+ * So units freed by one thread (e.g. kv finalize) reach the threads that
+ * allocate, and the wrapped allocator and its lock are only touched to
+ * refill or drain a whole batch at once.
+ * Cached extents are free space: they are reported by get_free() and
+ * foreach(), and returned to the wrapped allocator before any operation
+ * that modifies the free space map directly, and before an allocation is
+ * failed for lack of space.
+ */
+class MagazineAllocator : public Allocator {
+  struct alignas(64) Magazine {
+    ceph::mutex lock = ceph::make_mutex("MagazineAllocator::Magazine::lock");
+    std::vector<uint64_t> offsets;
+  };
+  std::unique_ptr<Allocator> alloc;
+  const size_t batch;
+  std::vector<Magazine> magazines;
+  /// full magazines released by one thread, waiting for an allocating one
+  ceph::mutex depot_lock = ceph::make_mutex("MagazineAllocator::depot_lock");
+  std::vector<std::vector<uint64_t>> depot;
+  const size_t depot_max;
+  std::atomic<uint64_t> cached_bytes = {0};
+
+  Magazine& _get_magazine() {
+    return magazines[
+      std::hash<std::thread::id>{}(std::this_thread::get_id()) %
+	magazines.size()];
+  }
+  // all magazine locks must be held
+  void _drain_all() {
+    release_set_t to_release;
+    for (auto& m : magazines) {
+      for (auto o : m.offsets) {
+	to_release.insert(o, block_size);
+      }
+      m.offsets.clear();
+    }
+    {
+      std::lock_guard l(depot_lock);
+      for (auto& full : depot) {
+	for (auto o : full) {
+	  to_release.insert(o, block_size);
+	}
+      }
+      depot.clear();
+    }
+    if (!to_release.empty()) {
+      cached_bytes -= to_release.size();
+      alloc->release(to_release);
+    }
+  }
+  void _lock_all() {
+    for (auto& m : magazines) {
+      m.lock.lock();
+    }
+  }
+  void _unlock_all() {
+    for (auto& m : magazines) {
+      m.lock.unlock();
+    }
+  }
+  // returns every cached unit to the wrapped allocator
+  void drain() {
+    _lock_all();
+    _drain_all();
+    _unlock_all();
+  }
+
+public:
+  MagazineAllocator(Allocator* _alloc, size_t num_magazines, size_t _batch)
+    : Allocator(_alloc->get_name(), _alloc->get_capacity(),
+		_alloc->get_block_size()),
+      alloc(_alloc),
+      batch(_batch),
+      magazines(num_magazines),
+      depot_max(num_magazines)
+  {
+    for (auto& m : magazines) {
+      m.offsets.reserve(batch);
+    }
+    depot.reserve(depot_max);
+  }
+  const char* get_type() const override {
+    return alloc->get_type();
+  }
+  const std::string& get_name() const override {
+    return alloc->get_name();
+  }
+
+  int64_t allocate(uint64_t want_size, uint64_t alloc_unit,
+		   uint64_t max_alloc_size, int64_t hint,
+		   PExtentVector *extents) override {
+    if (want_size != (uint64_t)block_size ||
+	alloc_unit != (uint64_t)block_size) {
+      size_t old_size = extents->size();
+      int64_t r = alloc->allocate(want_size, alloc_unit, max_alloc_size, hint,
+				  extents);
+      if ((r < 0 || (uint64_t)r < want_size) && cached_bytes.load()) {
+	// the free space we need may be sitting in the magazines
+	if (r > 0) {
+	  release_set_t partial;
+	  for (auto e = extents->begin() + old_size; e != extents->end(); ++e) {
+	    partial.insert(e->offset, e->length);
+	  }
+	  extents->erase(extents->begin() + old_size, extents->end());
+	  alloc->release(partial);
+	}
+	drain();
+	r = alloc->allocate(want_size, alloc_unit, max_alloc_size, hint,
+			    extents);
+      }
+      return r;
+    }
+    {
+      auto& m = _get_magazine();
+      std::lock_guard l(m.lock);
+      if (m.offsets.empty()) {
+	std::unique_lock dl(depot_lock);
+	if (!depot.empty()) {
+	  m.offsets.swap(depot.back());
+	  depot.pop_back();
+	} else {
+	  dl.unlock();
+	  PExtentVector refill;
+	  int64_t r = alloc->allocate(batch * block_size, block_size,
+				      block_size, hint, &refill);
+	  if (r > 0) {
+	    cached_bytes += r;
+	    // keep the lowest offset for the next pop
+	    for (auto e = refill.rbegin(); e != refill.rend(); ++e) {
+	      for (uint64_t o = e->offset + e->length; o > e->offset; ) {
+		o -= block_size;
+		m.offsets.push_back(o);
+	      }
+	    }
+	  }
+	}
+      }
+      if (!m.offsets.empty()) {
+	extents->emplace_back(m.offsets.back(), block_size);
+	m.offsets.pop_back();
+	cached_bytes -= block_size;
+	return block_size;
+      }
+    }
+    // nearly full: whatever is left may be cached by other threads
+    drain();
+    return alloc->allocate(want_size, alloc_unit, max_alloc_size, hint,
+			   extents);
+  }
+
+  void release(const release_set_t& release_set) override {
+    release_set_t to_release;
+    auto& m = _get_magazine();
+    {
+      std::lock_guard l(m.lock);
+      for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+	if (p.get_len() != (uint64_t)block_size) {
+	  to_release.insert(p.get_start(), p.get_len());
+	  continue;
+	}
+	if (m.offsets.size() >= batch) {
+	  // hand the full magazine over to the allocating threads
+	  std::vector<uint64_t> full;
+	  full.reserve(batch);
+	  full.swap(m.offsets);
+	  std::unique_lock dl(depot_lock);
+	  if (depot.size() < depot_max) {
+	    depot.emplace_back(std::move(full));
+	  } else {
+	    dl.unlock();
+	    for (auto o : full) {
+	      to_release.insert(o, block_size);
+	    }
+	    cached_bytes -= full.size() * block_size;
+	  }
+	}
+	m.offsets.push_back(p.get_start());
+	cached_bytes += block_size;
+      }
+    }
+    if (!to_release.empty()) {
+      alloc->release(to_release);
+    }
+  }
+
+  void dump() override {
+    _lock_all();
+    alloc->dump();
+    _unlock_all();
+  }
+  void foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override {
+    _lock_all();
+    alloc->foreach(notify);
+    for (auto& m : magazines) {
+      for (auto o : m.offsets) {
+	notify(o, block_size);
+      }
+    }
+    {
+      std::lock_guard l(depot_lock);
+      for (auto& full : depot) {
+	for (auto o : full) {
+	  notify(o, block_size);
+	}
+      }
+    }
+    _unlock_all();
+  }
+  void init_add_free(uint64_t offset, uint64_t length) override {
+    _lock_all();
+    _drain_all();
+    alloc->init_add_free(offset, length);
+    _unlock_all();
+  }
+  void init_rm_free(uint64_t offset, uint64_t length) override {
+    _lock_all();
+    _drain_all();
+    alloc->init_rm_free(offset, length);
+    _unlock_all();
+  }
+  uint64_t get_free() override {
+    return alloc->get_free() + cached_bytes.load();
+  }
+  double get_fragmentation() override {
+    return alloc->get_fragmentation();
+  }
+  void shutdown() override {
+    drain();
+    alloc->shutdown();
+  }
+};
+
 
 Allocator *Allocator::create(
   CephContext* cct,
@@ -48,15 +289,15 @@ Allocator *Allocator::create(
   } else if (type == "bitmap") {
     alloc = new BitmapAllocator(cct, size, block_size, name);
   } else if (type == "avl") {
-    return new AvlAllocator(cct, size, block_size, name);
+    alloc = new AvlAllocator(cct, size, block_size, name);
   } else if (type == "btree") {
-    return new BtreeAllocator(cct, size, block_size, name);
+    alloc = new BtreeAllocator(cct, size, block_size, name);
   } else if (type == "hybrid") {
-    return new HybridAvlAllocator(cct, size, block_size,
+    alloc = new HybridAvlAllocator(cct, size, block_size,
       cct->_conf.get_val<uint64_t>("bluestore_hybrid_alloc_mem_cap"),
       name);
   }  else if (type == "hybrid_btree2") {
-    return new HybridBtree2Allocator(cct, size, block_size,
+    alloc = new HybridBtree2Allocator(cct, size, block_size,
       cct->_conf.get_val<uint64_t>("bluestore_hybrid_alloc_mem_cap"),
       cct->_conf.get_val<double>("bluestore_btree2_alloc_weight_factor"),
       name);
@@ -68,6 +309,16 @@ Allocator *Allocator::create(
   return alloc;
 }
 
+Allocator *Allocator::add_magazines(CephContext* cct, Allocator* alloc)
+{
+  auto magazines = cct->_conf.get_val<uint64_t>("bluestore_allocator_magazines");
+  if (!magazines) {
+    return alloc;
+  }
+  return new MagazineAllocator(alloc, magazines,
+    cct->_conf.get_val<uint64_t>("bluestore_allocator_magazine_size"));
+}
+
 void Allocator::release(const PExtentVector& release_vec)
 {
   release_set_t release_set;
@@ -78,6 +78,9 @@ public:
     int64_t block_size,
     const std::string_view name = ""
     );
+  /// put per-thread magazines (bluestore_allocator_magazines) in front of
+  /// alloc, which the returned allocator then owns
+  static Allocator *add_magazines(CephContext* cct, Allocator* alloc);
 
 
   virtual const std::string& get_name() const = 0;
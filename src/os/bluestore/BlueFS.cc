@@ -415,6 +415,12 @@ void BlueFS::_init_logger()
                     "Average lock duration while compacting bluefs log",
                     "c_lt",
                     PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_time_avg   (l_bluefs_log_sync_lock_lat, "log_sync_lock_lat",
+                    "Average time a log sync waited for the log lock");
+  b.add_time_avg   (l_bluefs_log_expand_stall_lat, "log_expand_stall_lat",
+                    "Average time log expansion was stalled by compaction");
+  b.add_u64_counter(l_bluefs_log_sync_coalesced, "log_sync_coalesced",
+                    "Log syncs satisfied by another thread's log flush");
   b.add_time_avg   (l_bluefs_fsync_lat, "fsync_lat",
                     "Average bluefs fsync latency",
                     "fs_t",
@@ -1853,6 +1859,7 @@ int BlueFS::_replay(bool noop, bool to_stdout)
     log.seq_live = log_seq + 1;
     dirty.seq_live = log_seq + 1;
     log.t.seq = log.seq_live;
+    log.seq_synced = log_seq;
     dirty.seq_stable = log_seq;
 
     for (const auto &[filename, file] : nodes.file_map) {
@@ -3557,8 +3564,12 @@ int64_t BlueFS::_maybe_extend_log() {
 void BlueFS::_extend_log(uint64_t amount) {
   ceph_assert(ceph_mutex_is_locked(log.lock));
   std::unique_lock<ceph::mutex> ll(log.lock, std::adopt_lock);
-  while (log_forbidden_to_expand.load() == true) {
-    log_cond.wait(ll);
+  if (log_forbidden_to_expand.load() == true) {
+    auto t0 = mono_clock::now();
+    while (log_forbidden_to_expand.load() == true) {
+      log_cond.wait(ll);
+    }
+    logger->tinc(l_bluefs_log_expand_stall_lat, mono_clock::now() - t0);
   }
   ll.release();
   uint64_t allocated_before_extension = log.writer->file->fnode.get_allocated();
@@ -3685,7 +3696,30 @@ void BlueFS::_release_pending_allocations(vector<interval_set<uint64_t>>& to_rel
 
 int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
 {
+  tracepoint_log_sync(want_seq);
+  auto t0 = mono_clock::now();
   log.lock.lock();
+  logger->tinc(l_bluefs_log_sync_lock_lat, mono_clock::now() - t0);
+  if (want_seq && want_seq > log.seq_synced && fsyncs_in_flight.load() > 1) {
+    // other fsyncs are on their way; give them a chance to get their
+    // files into this log transaction instead of syncing the log again
+    // right after us.  log.lock is dropped while waiting, so one of them
+    // may flush for us as well; whoever syncs the log wakes the others.
+    auto batch_us = cct->_conf.get_val<uint64_t>("bluefs_log_sync_batch_us");
+    if (batch_us) {
+      std::unique_lock<ceph::mutex> ll(log.lock, std::adopt_lock);
+      log_cond.wait_for(ll, std::chrono::microseconds(batch_us),
+			[&] { return want_seq <= log.seq_synced; });
+      ll.release();
+    }
+  }
+  if (want_seq && want_seq <= log.seq_synced) {
+    dout(10) << __func__ << " want_seq " << want_seq << " <= seq_synced "
+      << log.seq_synced << ", done" << dendl;
+    logger->inc(l_bluefs_log_sync_coalesced);
+    log.lock.unlock();
+    return 0;
+  }
   dirty.lock.lock();
   if (want_seq && want_seq <= dirty.seq_stable) {
     dout(10) << __func__ << " want_seq " << want_seq << " <= seq_stable "
@@ -3705,6 +3739,8 @@ int BlueFS::_flush_and_sync_log_LD(uint64_t want_seq)
   _maybe_extend_log();
   _flush_and_sync_log_core();
   _flush_bdev(log.writer);
+  log.seq_synced = seq;
+  log_cond.notify_all();
   logger->set(l_bluefs_log_bytes, log.writer->file->fnode.size);
   //now log.lock is no longer needed
   log.lock.unlock();
@@ -3740,6 +3776,8 @@ int BlueFS::_flush_and_sync_log_jump_D(uint64_t jump_to)
   vselector->add_usage(log.writer->file->vselector_hint, log.writer->file->fnode.size);
 
   _flush_bdev(log.writer);
+  log.seq_synced = seq;
+  log_cond.notify_all();
 
   _clear_dirty_set_stable_D(seq);
   _release_pending_allocations(to_release);
@@ -4249,8 +4287,11 @@ int BlueFS::truncate(FileWriter *h, uint64_t offset)/*_WF_L*/
 
 int BlueFS::fsync(FileWriter *h)/*_WF_WD_WLD_WLNF_WNF*/
 {
+  ++fsyncs_in_flight;
   std::unique_lock hl(h->lock);
-  return _fsync(h, false);
+  int r = _fsync(h, false);
+  --fsyncs_in_flight;
+  return r;
 }
 
 int BlueFS::_fsync(FileWriter *h, bool force_dirty)/*_F_D_LD_LNF_NF*/
@@ -75,6 +75,9 @@ enum {
   l_bluefs_write_bytes,
   l_bluefs_compaction_lat,
   l_bluefs_compaction_lock_lat,
+  l_bluefs_log_sync_lock_lat,
+  l_bluefs_log_expand_stall_lat,
+  l_bluefs_log_sync_coalesced,
   l_bluefs_fsync_lat,
   l_bluefs_flush_lat,
   l_bluefs_unlink_lat,
@@ -568,6 +571,7 @@ private:
   struct {
     ceph::mutex lock = ceph::make_mutex("BlueFS::log.lock");
     uint64_t seq_live = 1;   //seq that log is currently writing to; mirrors dirty.seq_live
+    uint64_t seq_synced = 0; //last seq flushed to disk; dirty.seq_stable catches up after log.lock is dropped
     FileWriter *writer = nullptr;
     bluefs_transaction_t t;
     bool uses_envelope_mode = false; // true if any file is in envelope mode
@@ -588,6 +592,7 @@ private:
 
   ceph::condition_variable log_cond;                             ///< used for state control between log flush / log compaction
   std::atomic<bool> log_is_compacting{false};                    ///< signals that bluefs log is already ongoing compaction
+  std::atomic<uint32_t> fsyncs_in_flight{0};                     ///< fsyncs that may want to sync the log soon
   std::atomic<bool> log_forbidden_to_expand{false};              ///< used to signal that async compaction is in state
                                                                  ///  that prohibits expansion of bluefs log
   /*
@@ -923,6 +928,7 @@ public:
   debug_point_t<std::function<void(uint32_t)>> tracepoint_async_compact;
   void trim_free_space(const std::string& type, std::ostream& outss);
   debug_point_t<std::function<void()>> unittest_inject_delay;
+  debug_point_t<std::function<void(uint64_t)>> tracepoint_log_sync;
 
 private:
   // Wrappers for BlockDevice::read(...) and BlockDevice::read_random(...)
@@ -138,6 +138,7 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 SB id -> shared_blob_t
+const string PREFIX_ALLOC_JOURNAL = "J"; // NCB allocation base + journal
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
@@ -1079,6 +1080,26 @@ int64_t BlueStore::GarbageCollector::estimate(
   return expected_for_release - expected_allocations;
 }
 
+bool BlueStore::OnodeCacheShard::_maybe_unload_extents(BlueStore::Onode* o)
+{
+  // the onode is unpinned and we hold the lock, so nobody else can get at
+  // its extent map; pending kv updates must be visible before we rely on
+  // re-reading the shards though
+  if (!unload_extent_shards || !o->exists || o->flushing_count.load()) {
+    return false;
+  }
+  unsigned n = o->extent_map.unload_clean_shards();
+  if (n == 0) {
+    return false;
+  }
+  if (logger) {
+    logger->inc(l_bluestore_onode_shard_unloads, n);
+  }
+  dout(20) << __func__ << " " << this << " " << o->oid << " unloaded " << n
+	   << " shards" << dendl;
+  return true;
+}
+
 // LruOnodeCacheShard
 struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
   typedef boost::intrusive::list<
@@ -1178,6 +1199,11 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
       *(o->cache_age_bin) -= 1;
       if (o->pin_nref > 1) {
         dout(20) << __func__ << " " << this << " " << " " << " " << o->oid << dendl;
+      } else if (_maybe_unload_extents(o)) {
+        // keep the (much smaller) onode around a bit longer
+        lru.push_front(*o);
+        o->cache_age_bin = age_bins.front();
+        *(o->cache_age_bin) += 1;
       } else {
 	ceph_assert(num);
         --num;
@@ -1208,6 +1234,141 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
 #endif
 };
 
+// ClockOnodeCacheShard
+//
+// CLOCK (second chance) replacement.  Every cached onode stays in the ring,
+// pinned or not, so unpinning an onode that still exists needs neither the
+// shard lock nor any list manipulation: it only sets the onode's reference
+// bit.  The hand (back of the ring) skips pinned and referenced onodes,
+// clearing the bit, and evicts the first one that is neither.
+struct ClockOnodeCacheShard : public BlueStore::OnodeCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Onode,
+    boost::intrusive::member_hook<
+      BlueStore::Onode,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Onode::lru_item> > list_t;
+
+  list_t ring;
+  uint64_t last_pinned = 0; ///< pinned onodes seen by the last sweep
+
+  explicit ClockOnodeCacheShard(CephContext *cct) : BlueStore::OnodeCacheShard(cct) {}
+
+  void _add(BlueStore::Onode* o, int level) override
+  {
+    o->set_cached();
+    o->cache_ref = level > 0;
+    ring.push_front(*o);
+    o->cache_age_bin = age_bins.front();
+    *(o->cache_age_bin) += 1;
+    ++num;
+    dout(20) << __func__ << " " << this << " " << o->oid << " added, num="
+             << num << dendl;
+  }
+  void _rm(BlueStore::Onode* o) override
+  {
+    o->clear_cached();
+    ceph_assert(o->lru_item.is_linked());
+    *(o->cache_age_bin) -= 1;
+    ring.erase(ring.iterator_to(*o));
+    ceph_assert(num);
+    --num;
+    dout(20) << __func__ << " " << this << " " << " " << o->oid << " removed, num=" << num << dendl;
+  }
+
+  void maybe_unpin(BlueStore::Onode* o) override
+  {
+    if (o->exists) {
+      // the onode never left the ring; just let the hand know it was used
+      o->cache_ref.store(true, std::memory_order_relaxed);
+      return;
+    }
+    // removed onodes are dropped as soon as the last pin goes, as the
+    // LRU shard does, rather than left for the hand to find
+    OnodeCacheShard* ocs = this;
+    ocs->lock.lock();
+    // It is possible that during waiting split_cache moved us to different OnodeCacheShard.
+    while (ocs != o->c->get_onode_cache()) {
+      ocs->lock.unlock();
+      ocs = o->c->get_onode_cache();
+      ocs->lock.lock();
+    }
+    if (o->is_cached() && o->pin_nref == 1 && !o->exists) {
+      ocs->_rm(o);
+      dout(20) << __func__ << " " << ocs << " " << o->oid << " removed"
+               << dendl;
+      // remove will also decrement nref
+      o->c->onode_space._remove(o->oid);
+    }
+    ocs->lock.unlock();
+  }
+
+  void _trim_to(uint64_t new_size) override
+  {
+    if (new_size >= num) {
+      return; // don't even try
+    }
+    uint64_t n = num - new_size;
+    // each onode gets at most one second chance per sweep, so a ring of
+    // pinned or hot onodes can't keep us here forever
+    uint64_t budget = ring.size() * 2;
+    uint64_t pinned = 0;
+    while (n > 0 && budget-- > 0 && !ring.empty()) {
+      BlueStore::Onode *o = &ring.back();
+      ring.pop_back();
+      if (o->pin_nref > 1 ||
+	  o->cache_ref.exchange(false, std::memory_order_relaxed)) {
+	pinned += o->pin_nref > 1;
+	ring.push_front(*o);
+	if (o->cache_age_bin != age_bins.front()) {
+	  *(o->cache_age_bin) -= 1;
+	  o->cache_age_bin = age_bins.front();
+	  *(o->cache_age_bin) += 1;
+	}
+	continue;
+      }
+      if (_maybe_unload_extents(o)) {
+	--n;
+	ring.push_front(*o);
+	*(o->cache_age_bin) -= 1;
+	o->cache_age_bin = age_bins.front();
+	*(o->cache_age_bin) += 1;
+	continue;
+      }
+      dout(20) << __func__ << "  rm " << o->oid << " "
+               << o->nref << " " << o->cached << dendl;
+      *(o->cache_age_bin) -= 1;
+      ceph_assert(num);
+      --num;
+      --n;
+      o->clear_cached();
+      o->c->onode_space._remove(o->oid);
+    }
+    last_pinned = pinned;
+  }
+  void _move_pinned(OnodeCacheShard *to, BlueStore::Onode *o) override
+  {
+    if (to == this) {
+      return;
+    }
+    _rm(o);
+    ceph_assert(o->nref > 1);
+    to->_add(o, 0);
+  }
+  void add_stats(uint64_t *onodes, uint64_t *pinned_onodes) override
+  {
+    std::lock_guard l(lock);
+    *onodes += num;
+    // pinned onodes stay in the ring, counting them is left to the sweep
+    *pinned_onodes += std::min(last_pinned, num.load());
+  }
+#ifdef DEBUG_CACHE
+  void _audit(const char *when) override
+  {
+  }
+#endif
+};
+
 // OnodeCacheShard
 BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     CephContext* cct,
@@ -1215,9 +1376,13 @@ BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     PerfCounters *logger)
 {
   BlueStore::OnodeCacheShard *c = nullptr;
-  // Currently we only implement an LRU cache for onodes
-  c = new LruOnodeCacheShard(cct);
+  if (type == "clock")
+    c = new ClockOnodeCacheShard(cct);
+  else
+    c = new LruOnodeCacheShard(cct);
   c->logger = logger;
+  c->unload_extent_shards =
+    cct->_conf.get_val<bool>("bluestore_cache_unload_extent_shards");
   return c;
 }
 
@@ -1676,7 +1841,7 @@ BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
   BufferCacheShard *c = nullptr;
   if (type == "lru")
     c = new LruBufferCacheShard(store);
-  else if (type == "2q")
+  else if (type == "2q" || type == "clock") // clock is for onodes only
     c = new TwoQBufferCacheShard(store);
   else
     ceph_abort_msg("unrecognized cache type");
@@ -4319,6 +4484,37 @@ void BlueStore::ExtentMap::maybe_load_shard(
   }
 }
 
+unsigned BlueStore::ExtentMap::unload_clean_shards()
+{
+  if (shards.empty() || needs_reshard()) {
+    // inline extents are kept with the onode itself
+    return 0;
+  }
+  unsigned unloaded = 0;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    auto& s = shards[i];
+    if (!s.loaded || s.dirty) {
+      continue;
+    }
+    uint32_t shard_start = s.shard_info->offset;
+    uint32_t shard_end = i + 1 < shards.size() ?
+      shards[i + 1].shard_info->offset : OBJECT_MAX_SIZE;
+    // blobs referenced from several shards are spanning blobs and stay
+    // in spanning_blob_map, the rest go away with their extents
+    Extent dummy(shard_start);
+    auto p = extent_map.lower_bound(dummy);
+    while (p != extent_map.end() && p->logical_offset < shard_end) {
+      p = extent_map.erase_and_dispose(p, DeleteDisposer());
+    }
+    dout(30) << __func__ << " unloaded shard 0x" << std::hex << shard_start
+	     << std::dec << " (" << s.extents << " extents)" << dendl;
+    s.extents = 0;
+    s.loaded = false;
+    ++unloaded;
+  }
+  return unloaded;
+}
+
 void BlueStore::ExtentMap::dirty_range(
   uint32_t offset,
   uint32_t length)
@@ -5523,6 +5719,18 @@ void *BlueStore::MempoolThread::entry()
     interval_stats_trim = false;
 
     store->refresh_perf_counters();
+    uint64_t journal_max = store->cct->_conf.get_val<uint64_t>(
+      "bluestore_allocation_journal_checkpoint_entries");
+    if (store->alloc_journal_enabled && journal_max &&
+	store->alloc_journal_pending >= journal_max &&
+	!store->alloc_journal_checkpointing.exchange(true)) {
+      // keep the kv reads and the sync commit off the cache trimming path
+      store->alloc_journal_finisher.queue(
+	new LambdaContext([store = store](int) {
+	  store->_alloc_journal_checkpoint();
+	  store->alloc_journal_checkpointing = false;
+	}));
+    }
     uint64_t period = store->cct->_conf.get_val<uint64_t>("bluestore_fragmentation_check_period");
     if (period != 0 && store->alloc) {
       auto now = mono_clock::now();
@@ -5684,8 +5892,7 @@ BlueStore::BlueStore(CephContext *cct,
   : ObjectStore(cct, path),
     throttle(cct),
     finisher(cct, "commit_finisher", "cfin"),
-    kv_sync_thread(this),
-    kv_finalize_thread(this),
+    alloc_journal_finisher(cct, "alloc_journal_finisher", "bstore_ajrnl"),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(std::countr_zero(_min_alloc_size)),
     mempool_thread(this)
@@ -6273,6 +6480,14 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_reads_with_retries, "reads_with_retries",
                     "Read operations that required at least one retry due to failed checksum validation",
 		    "rd_r", PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_read_shared_bytes, "read_shared_bytes",
+		    "Bytes returned by reads as references to cached or "
+		    "freshly read buffers",
+		    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_read_copied_bytes, "read_copied_bytes",
+		    "Bytes returned by reads that had to be materialized "
+		    "into new buffers (holes, decompression)",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_time_avg(l_bluestore_read_lat, "read_lat",
 		 "Average read latency",
 		 "r_l", PerfCountersBuilder::PRIO_CRITICAL);
@@ -6391,6 +6606,10 @@ void BlueStore::_init_logger()
 	    "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
 	    "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64_counter(l_bluestore_compress_pool_skipped, "compress_pool_skipped",
+	    "Sum for blobs left uncompressed due to saturated compression pool");
+  b.add_u64_counter(l_bluestore_compress_pool_queued, "compress_pool_queued",
+	    "Sum for blobs handed to the compression thread pool");
   //****************************************
 
   // onode cache stats
@@ -6405,11 +6624,16 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_onode_misses, "onode_misses",
 		    "Count of onode cache lookup misses",
 		    "o_ms", PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_onode_prefetched, "onode_prefetched",
+		    "Count of onodes loaded into cache by prefetch hints");
   b.add_u64_counter(l_bluestore_onode_shard_hits, "onode_shard_hits",
 		    "Count of onode shard cache lookups hits");
   b.add_u64_counter(l_bluestore_onode_shard_misses,
 		    "onode_shard_misses",
 		    "Count of onode shard cache lookups misses");
+  b.add_u64_counter(l_bluestore_onode_shard_unloads,
+		    "onode_shard_unloads",
+		    "Count of clean onode shards dropped from cache");
   b.add_u64(l_bluestore_extents, "onode_extents",
 	    "Number of extents in cache");
   b.add_u64(l_bluestore_blobs, "onode_blobs",
@@ -6548,6 +6772,12 @@ void BlueStore::_init_logger()
     "Average bluestore allocator latency",
     "bsal",
     PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_alloc_journal_entries,
+    "alloc_journal_entries",
+    "Count of allocation journal records written");
+  b.add_time_avg(l_bluestore_alloc_journal_checkpoint_lat,
+    "alloc_journal_checkpoint_lat",
+    "Average time to fold allocation journal into its base");
 
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
@@ -7278,6 +7508,7 @@ int BlueStore::_create_alloc()
 	       << dendl;
     return -EINVAL;
   }
+  alloc = Allocator::add_magazines(cct, alloc);
 
   // BlueFS will share the same allocator
   shared_alloc.set(alloc, alloc_size);
@@ -7295,6 +7526,7 @@ int BlueStore::_init_alloc()
 
   uint64_t num = 0, bytes = 0;
   utime_t start_time = ceph_clock_now();
+  alloc_journal_enabled = false;
   if (!fm->is_null_manager()) {
     // This is the original path - loading allocation map from RocksDB and feeding into the allocator
     dout(5) << __func__ << "::NCB::loading allocation from FM -> alloc" << dendl;
@@ -7321,6 +7553,9 @@ int BlueStore::_init_alloc()
     }
     if (restore_allocator(alloc, &num, &bytes) == 0) {
       dout(5) << __func__ << "::NCB::restore_allocator() completed successfully alloc=" << alloc << dendl;
+    } else if (cct->_conf.get_val<bool>("bluestore_allocation_journal") &&
+	       _restore_allocator_from_journal(alloc, &num, &bytes) == 0) {
+      dout(1) << __func__ << "::NCB::restored allocation from the allocation journal" << dendl;
     } else {
       // This must mean that we had an unplanned shutdown and didn't manage to destage the allocator
       dout(0) << __func__ << "::NCB::restore_allocator() failed! Run Full Recovery from ONodes (might take a while) ..." << dendl;
@@ -7339,6 +7574,15 @@ int BlueStore::_init_alloc()
                            bdev_label.size - before_expansion_bdev_size);
       need_to_destage_allocation_file = true;    
     }
+    if (cct->_conf.get_val<bool>("bluestore_allocation_journal")) {
+      // BlueStore-only view, same as the allocation file; it becomes the
+      // journal base once the DB is reopened for writing
+      alloc_journal_base.clear();
+      alloc->foreach([&](uint64_t offset, uint64_t length) {
+	alloc_journal_base.union_insert(offset, length);
+      });
+      alloc_journal_enabled = true;
+    }
   }
   before_expansion_bdev_size = 0;
 
@@ -7846,6 +8090,9 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
       goto out_alloc;
     }
   }
+  if (!read_only && !to_repair) {
+    _alloc_journal_reset();
+  }
 
   // when function is called in repair mode (to_repair=true) we skip db->open()/create()
   if (!is_db_rotational() && !read_only && !to_repair && cct->_conf->bluestore_allocation_from_file) {
@@ -8152,6 +8399,7 @@ void BlueStore::_close_db()
       }
 
       std::lock_guard l(vstatfs_lock);
+      _fold_statfs();
       for(auto &p : osd_pools) {
         string key;
         get_pool_stat_key(p.first, &key);
@@ -8169,6 +8417,7 @@ void BlueStore::_close_db()
       bufferlist bl;
       {
         std::lock_guard l(vstatfs_lock);
+        _fold_statfs();
         vstatfs.encode(bl);
         vstatfs.publish(&s);
       }
@@ -8312,6 +8561,9 @@ void BlueStore::_set_per_pool_omap()
 
 void BlueStore::_open_statfs()
 {
+  std::lock_guard l(vstatfs_lock);
+  // drop whatever is still pending from a previous mount
+  _fold_statfs();
   osd_pools.clear();
   vstatfs.reset();
 
@@ -9402,6 +9654,7 @@ int BlueStore::_mount()
   }
 
   mempool_thread.init();
+  _compress_start();
 
   if ((!per_pool_stat_collection || per_pool_omap != OMAP_PER_PG) &&
     cct->_conf->bluestore_fsck_quick_fix_on_mount == true) {
@@ -9432,6 +9685,7 @@ int BlueStore::umount()
   ceph_assert(alloc);
 
   if (!_kv_only) {
+    _compress_stop();
     mempool_thread.shutdown();
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
@@ -9559,6 +9813,10 @@ void BlueStore::_fsck_check_statfs(
   string key;
   store_statfs_t actual_statfs;
   store_statfs_t s;
+  {
+    std::lock_guard l(vstatfs_lock);
+    _fold_statfs();
+  }
   {
     // make a copy
     per_pool_statfs my_expected_pool_statfs(expected_pool_statfs);
@@ -9989,6 +10247,10 @@ BlueStore::OnodeRef BlueStore::fsck_check_objects_shallow(
     } else if (depth != FSCK_SHALLOW) {
       ceph_assert(used_blocks);
       string ctx_descr = " oid " + stringify(oid);
+      // the below lock is optional and provided in multithreading mode only
+      if (ctx.used_blocks_lock) {
+        ctx.used_blocks_lock->lock();
+      }
       errors += _fsck_check_extents(ctx_descr,
 	blob.get_extents(),
         blob.is_compressed(),
@@ -9998,6 +10260,9 @@ BlueStore::OnodeRef BlueStore::fsck_check_objects_shallow(
         *res_statfs,
         *pool_fsck_stat,
         depth);
+      if (ctx.used_blocks_lock) {
+        ctx.used_blocks_lock->unlock();
+      }
     } else {
       errors += _fsck_sum_extents(
         blob.get_extents(),
@@ -10078,6 +10343,7 @@ public:
       ghobject_t oid;
       string key;
       bufferlist value;
+      mempool::bluestore_fsck::list<string> shard_keys;
     };
     struct Batch {
       std::atomic<size_t> running = { 0 };
@@ -10104,6 +10370,13 @@ public:
     shared_blob_2hash_tracker_t* sb_ref_counts = nullptr;
     BlueStoreRepairer* repairer = nullptr;
 
+    // regular/deep mode only
+    BlueStore::FSCKDepth depth = BlueStore::FSCK_SHALLOW;
+    ceph::mutex* used_lock = nullptr; ///< protects the below + used_blocks
+    BlueStore::mempool_dynamic_bitset* used_blocks = nullptr;
+    BlueStore::uint64_t_btree_t* used_nids = nullptr;
+    BlueStore::uint64_t_btree_t* used_omap_head = nullptr;
+
     Batch* batches = nullptr;
     size_t last_batch_pos = 0;
     bool batch_acquired = false;
@@ -10129,6 +10402,18 @@ public:
       delete[] batches;
     }
 
+    void set_full_check(BlueStore::FSCKDepth _depth,
+                        ceph::mutex* _used_lock,
+                        BlueStore::mempool_dynamic_bitset* _used_blocks,
+                        BlueStore::uint64_t_btree_t* _used_nids,
+                        BlueStore::uint64_t_btree_t* _used_omap_head) {
+      depth = _depth;
+      used_lock = _used_lock;
+      used_blocks = _used_blocks;
+      used_nids = _used_nids;
+      used_omap_head = _used_omap_head;
+    }
+
     /// Remove all work items from the queue.
     void _clear() override {
       //do nothing
@@ -10169,8 +10454,8 @@ public:
         batch->num_blobs,
         batch->num_sharded_objects,
         batch->num_spanning_blobs,
-        nullptr, // used_blocks
-        nullptr, //used_omap_head
+        used_blocks,
+        used_omap_head,
 	nullptr,
         sb_info_lock,
         *sb_info,
@@ -10179,10 +10464,26 @@ public:
         batch->expected_pool_statfs,
         batch->per_pool_fsck_stats,
         repairer);
+      ctx.used_blocks_lock = used_lock;
 
       for (size_t i = 0; i < batch->entry_count; i++) {
         auto& entry = batch->entries[i];
 
+        if (depth != BlueStore::FSCK_SHALLOW) {
+          store->fsck_check_objects_full(
+            depth,
+            entry.pool_id,
+            entry.c,
+            entry.oid,
+            entry.key,
+            entry.value,
+            entry.shard_keys,
+            *used_nids,
+            used_lock,
+            ctx);
+          entry.shard_keys.clear();
+          continue;
+        }
         store->fsck_check_objects_shallow(
           BlueStore::FSCK_SHALLOW,
           entry.pool_id,
@@ -10210,7 +10511,8 @@ public:
       BlueStore::CollectionRef c,
       const ghobject_t& oid,
       const string& key,
-      const bufferlist& value) {
+      const bufferlist& value,
+      mempool::bluestore_fsck::list<string>* shard_keys = nullptr) {
       bool res = false;
       size_t pos0 = last_batch_pos;
       if (!batch_acquired) {
@@ -10238,6 +10540,9 @@ public:
         entry.oid = oid;
         entry.key = key;
         entry.value = value;
+        if (shard_keys) {
+          entry.shard_keys.swap(*shard_keys);
+        }
 
         ++batch.entry_count;
         if (batch.entry_count == BatchLen) {
@@ -10447,6 +10752,185 @@ void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
   }
 }
 
+void BlueStore::_fsck_check_object_full(
+  FSCKDepth depth,
+  CollectionRef& c,
+  const ghobject_t& oid,
+  OnodeRef& o,
+  const map<BlobRef, bluestore_blob_t::unused_t>& referenced,
+  uint64_t_btree_t& used_nids,
+  ceph::mutex* lock,
+  const BlueStore::FSCK_ObjectCtx& ctx)
+{
+  auto& errors = ctx.errors;
+
+  ceph_assert(o != nullptr);
+  if (o->onode.nid) {
+    if (o->onode.nid > nid_max) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+        << " > nid_max " << nid_max << dendl;
+      ++errors;
+    }
+    std::unique_lock<ceph::mutex> l;
+    if (lock) {
+      l = std::unique_lock(*lock);
+    }
+    if (!used_nids.insert(o->onode.nid).second) {
+      derr << "fsck error: " << oid << " nid " << o->onode.nid
+        << " already in use" << dendl;
+      ++errors;
+      return; // go for next object
+    }
+  }
+  for (auto& i : referenced) {
+    dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
+      << std::dec << " for " << *i.first << dendl;
+    const bluestore_blob_t& blob = i.first->get_blob();
+    if (i.second & blob.unused) {
+      derr << "fsck error: " << oid << " blob claims unused 0x"
+        << std::hex << blob.unused
+        << " but extents reference 0x" << i.second << std::dec
+        << " on blob " << *i.first << dendl;
+      ++errors;
+    }
+    if (blob.has_csum()) {
+      uint64_t blob_len = blob.get_logical_length();
+      uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused) * 8);
+      unsigned csum_count = blob.get_csum_count();
+      unsigned csum_chunk_size = blob.get_csum_chunk_size();
+      for (unsigned p = 0; p < csum_count; ++p) {
+        unsigned pos = p * csum_chunk_size;
+        unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
+        unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
+        unsigned mask = 1u << firstbit;
+        for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
+          mask |= 1u << b;
+        }
+        if ((blob.unused & mask) == mask) {
+          // this csum chunk region is marked unused
+          if (blob.get_csum_item(p) != 0) {
+            derr << "fsck error: " << oid
+              << " blob claims csum chunk 0x" << std::hex << pos
+              << "~" << csum_chunk_size
+              << " is unused (mask 0x" << mask << " of unused 0x"
+              << blob.unused << ") but csum is non-zero 0x"
+              << blob.get_csum_item(p) << std::dec << " on blob "
+              << *i.first << dendl;
+            ++errors;
+          }
+        }
+      }
+    }
+  }
+  // omap
+  if (o->onode.has_omap()) {
+    ceph_assert(ctx.used_omap_head);
+    std::unique_lock<ceph::mutex> l;
+    if (lock) {
+      l = std::unique_lock(*lock);
+    }
+    if (ctx.used_omap_head->count(o->onode.nid)) {
+      derr << "fsck error: " << o->oid << " omap_head " << o->onode.nid
+           << " already in use" << dendl;
+      ++errors;
+    } else {
+      ctx.used_omap_head->insert(o->onode.nid);
+    }
+  } // if (o->onode.has_omap())
+  if (depth == FSCK_DEEP) {
+    bufferlist bl;
+    uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
+    uint64_t offset = 0;
+    do {
+      uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
+      int r = _do_read(c.get(), o, offset, l, bl,
+        CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+      if (r < 0) {
+        ++errors;
+        derr << "fsck error: " << oid << std::hex
+          << " error during read: "
+          << " " << offset << "~" << l
+          << " " << cpp_strerror(r) << std::dec
+          << dendl;
+        break;
+      }
+      offset += l;
+    } while (offset < o->onode.size);
+  } // deep
+}
+
+void BlueStore::fsck_check_objects_full(
+  FSCKDepth depth,
+  int64_t pool_id,
+  CollectionRef c,
+  const ghobject_t& oid,
+  const string& key,
+  const bufferlist& value,
+  const mempool::bluestore_fsck::list<string>& shard_keys,
+  uint64_t_btree_t& used_nids,
+  ceph::mutex* lock,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  auto& errors = ctx.errors;
+  mempool::bluestore_fsck::list<string> expecting_shards;
+  map<BlobRef, bluestore_blob_t::unused_t> referenced;
+
+  OnodeRef o = fsck_check_objects_shallow(
+    depth,
+    pool_id,
+    c,
+    oid,
+    key,
+    value,
+    &expecting_shards,
+    &referenced,
+    ctx);
+
+  // both lists are in key order, shard_keys are the ones found right after
+  // the onode key while walking the keyspace.  errors are counted exactly
+  // like the serial walk in _fsck_check_objects does, so the result does
+  // not depend on bluestore_fsck_threads.
+  auto e = expecting_shards.begin();
+  for (auto& s : shard_keys) {
+    while (e != expecting_shards.end() && *e < s) {
+      derr << "fsck error: missing shard key "
+        << pretty_binary_string(*e) << dendl;
+      ++errors;
+      ++e;
+    }
+    if (e != expecting_shards.end() && *e == s) {
+      // all good
+      ++e;
+      continue;
+    }
+    uint32_t offset;
+    string okey;
+    get_key_extent_shard(s, &okey, &offset);
+    derr << "fsck error: stray shard 0x" << std::hex << offset
+      << std::dec << " of " << oid << dendl;
+    if (e == expecting_shards.end()) {
+      derr << "fsck error: " << pretty_binary_string(s)
+        << " is unexpected" << dendl;
+      ++errors;
+      continue;
+    }
+    // every shard still expected sorts after the stray one
+    for (; e != expecting_shards.end(); ++e) {
+      derr << "fsck error:   saw " << pretty_binary_string(s) << dendl;
+      derr << "fsck error:   exp " << pretty_binary_string(*e) << dendl;
+      ++errors;
+    }
+  }
+  if (e != expecting_shards.end()) {
+    for (; e != expecting_shards.end(); ++e) {
+      derr << "fsck error: missing shard key "
+        << pretty_binary_string(*e) << dendl;
+    }
+    ++errors;
+  }
+  _fsck_check_object_full(depth, c, oid, o, referenced, used_nids, lock, ctx);
+}
+
 void BlueStore::_fsck_check_objects(
   FSCKDepth depth,
   BlueStore::FSCK_ObjectCtx& ctx)
@@ -10461,6 +10945,13 @@ void BlueStore::_fsck_check_objects(
 
   size_t processed_myself = 0;
 
+  const size_t full_thread_count =
+    cct->_conf.get_val<uint64_t>("bluestore_fsck_threads");
+  if (depth != FSCK_SHALLOW && full_thread_count > 0) {
+    _fsck_check_objects_parallel(depth, full_thread_count, ctx);
+    return;
+  }
+
   auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
   mempool::bluestore_fsck::list<string> expecting_shards;
   if (it) {
@@ -10603,93 +11094,9 @@ void BlueStore::_fsck_check_objects(
       }
 
       if (depth != FSCK_SHALLOW) {
-        ceph_assert(o != nullptr);
-        if (o->onode.nid) {
-          if (o->onode.nid > nid_max) {
-            derr << "fsck error: " << oid << " nid " << o->onode.nid
-              << " > nid_max " << nid_max << dendl;
-            ++errors;
-          }
-          if (used_nids.count(o->onode.nid)) {
-            derr << "fsck error: " << oid << " nid " << o->onode.nid
-              << " already in use" << dendl;
-            ++errors;
-            continue; // go for next object
-          }
-          used_nids.insert(o->onode.nid);
-        }
-        for (auto& i : referenced) {
-          dout(20) << __func__ << "  referenced 0x" << std::hex << i.second
-            << std::dec << " for " << *i.first << dendl;
-          const bluestore_blob_t& blob = i.first->get_blob();
-          if (i.second & blob.unused) {
-            derr << "fsck error: " << oid << " blob claims unused 0x"
-              << std::hex << blob.unused
-              << " but extents reference 0x" << i.second << std::dec
-              << " on blob " << *i.first << dendl;
-            ++errors;
-          }
-          if (blob.has_csum()) {
-            uint64_t blob_len = blob.get_logical_length();
-            uint64_t unused_chunk_size = blob_len / (sizeof(blob.unused) * 8);
-            unsigned csum_count = blob.get_csum_count();
-            unsigned csum_chunk_size = blob.get_csum_chunk_size();
-            for (unsigned p = 0; p < csum_count; ++p) {
-              unsigned pos = p * csum_chunk_size;
-              unsigned firstbit = pos / unused_chunk_size;    // [firstbit,lastbit]
-              unsigned lastbit = (pos + csum_chunk_size - 1) / unused_chunk_size;
-              unsigned mask = 1u << firstbit;
-              for (unsigned b = firstbit + 1; b <= lastbit; ++b) {
-                mask |= 1u << b;
-              }
-              if ((blob.unused & mask) == mask) {
-                // this csum chunk region is marked unused
-                if (blob.get_csum_item(p) != 0) {
-                  derr << "fsck error: " << oid
-                    << " blob claims csum chunk 0x" << std::hex << pos
-                    << "~" << csum_chunk_size
-                    << " is unused (mask 0x" << mask << " of unused 0x"
-                    << blob.unused << ") but csum is non-zero 0x"
-                    << blob.get_csum_item(p) << std::dec << " on blob "
-                    << *i.first << dendl;
-                  ++errors;
-                }
-              }
-            }
-          }
-        }
-        // omap
-        if (o->onode.has_omap()) {
-          ceph_assert(ctx.used_omap_head);
-          if (ctx.used_omap_head->count(o->onode.nid)) {
-            derr << "fsck error: " << o->oid << " omap_head " << o->onode.nid
-                 << " already in use" << dendl;
-            ++errors;
-          } else {
-            ctx.used_omap_head->insert(o->onode.nid);
-          }
-        } // if (o->onode.has_omap())
-        if (depth == FSCK_DEEP) {
-          bufferlist bl;
-          uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
-          uint64_t offset = 0;
-          do {
-            uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
-            int r = _do_read(c.get(), o, offset, l, bl,
-              CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
-            if (r < 0) {
-              ++errors;
-              derr << "fsck error: " << oid << std::hex
-                << " error during read: "
-                << " " << offset << "~" << l
-                << " " << cpp_strerror(r) << std::dec
-                << dendl;
-              break;
-            }
-            offset += l;
-          } while (offset < o->onode.size);
-        } // deep
-      } //if (depth != FSCK_SHALLOW)
+        _fsck_check_object_full(depth, c, oid, o, referenced, used_nids,
+          nullptr, ctx);
+      }
     } // for (it->lower_bound(string()); it->valid(); it->next())
     if (depth == FSCK_SHALLOW && thread_count > 0) {
       wq->finalize(thread_pool, ctx);
@@ -10704,6 +11111,140 @@ void BlueStore::_fsck_check_objects(
     }
   } // if (it)
 }
+
+void BlueStore::_fsck_check_objects_parallel(
+  FSCKDepth depth,
+  size_t thread_count,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  auto& errors = ctx.errors;
+  ceph_assert(depth != FSCK_SHALLOW);
+  ceph_assert(ctx.sb_info_lock);
+
+  auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
+  if (!it) {
+    return;
+  }
+  uint64_t_btree_t used_nids;
+  ceph::mutex used_lock = ceph::make_mutex("BlueStore::fsck::used_lock");
+  ctx.used_blocks_lock = &used_lock;
+
+  // The keyspace is cut into contiguous ranges of onodes, each carrying the
+  // extent shard keys that follow it, and the ranges are checked by the pool
+  // while this thread keeps walking. A fixed number of ranges in flight keeps
+  // memory bounded; used blocks go to the single shared bitmap as one copy
+  // per range would cost a device sized bitmap each.
+  typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
+  std::unique_ptr<WQ> wq(
+    new WQ(
+      "FSCKWorkQueue",
+      thread_count * 32,
+      this,
+      ctx.sb_info_lock,
+      ctx.sb_info,
+      ctx.sb_ref_counts,
+      ctx.repairer));
+  wq->set_full_check(depth, &used_lock, ctx.used_blocks, &used_nids,
+    ctx.used_omap_head);
+
+  ShallowFSCKThreadPool thread_pool(cct, "FSCKThreadPool", "FSCK", thread_count);
+  thread_pool.add_work_queue(wq.get());
+  thread_pool.start();
+
+  size_t processed_myself = 0;
+  CollectionRef c;
+  int64_t pool_id = -1;
+  spg_t pgid;
+  // the object being collected
+  ghobject_t oid;
+  string key;
+  bufferlist value;
+  mempool::bluestore_fsck::list<string> shard_keys;
+  auto flush = [&]() {
+    if (key.empty()) {
+      return;
+    }
+    if (!wq->queue(pool_id, c, oid, key, value, &shard_keys)) {
+      ++processed_myself;
+      fsck_check_objects_full(
+        depth,
+        pool_id,
+        c,
+        oid,
+        key,
+        value,
+        shard_keys,
+        used_nids,
+        &used_lock,
+        ctx);
+    }
+    key.clear();
+    shard_keys.clear();
+  };
+
+  for (it->lower_bound(string()); it->valid(); it->next()) {
+    dout(30) << __func__ << " key "
+      << pretty_binary_string(it->key()) << dendl;
+    if (is_extent_shard_key(it->key())) {
+      uint32_t offset;
+      string okey;
+      get_key_extent_shard(it->key(), &okey, &offset);
+      if (!key.empty() && okey == key) {
+        shard_keys.push_back(it->key());
+      } else {
+        derr << "fsck error: stray shard 0x" << std::hex << offset
+          << std::dec << ", " << pretty_binary_string(it->key())
+          << " is unexpected" << dendl;
+        ++errors;
+      }
+      continue;
+    }
+    flush();
+
+    int r = get_key_object(it->key(), &oid);
+    if (r < 0) {
+      derr << "fsck error: bad object key "
+        << pretty_binary_string(it->key()) << dendl;
+      ++errors;
+      continue;
+    }
+    if (!c ||
+      oid.shard_id != pgid.shard ||
+      oid.hobj.get_logical_pool() != (int64_t)pgid.pool() ||
+      !c->contains(oid)) {
+      c = nullptr;
+      for (auto& p : coll_map) {
+        if (p.second->contains(oid)) {
+          c = p.second;
+          break;
+        }
+      }
+      if (!c) {
+        derr << "fsck error: stray object " << oid
+          << " not owned by any collection" << dendl;
+        ++errors;
+        continue;
+      }
+      pool_id = c->cid.is_pg(&pgid) ? pgid.pool() : META_POOL_ID;
+      dout(20) << __func__ << "  collection " << c->cid << " " << c->cnode
+        << dendl;
+    }
+    key = it->key();
+    value = it->value();
+  }
+  flush();
+
+  wq->finalize(thread_pool, ctx);
+  ctx.used_blocks_lock = nullptr;
+  if (processed_myself) {
+    dout(0) << __func__ << " partial offload"
+            << ", done myself " << processed_myself
+            << " of " << ctx.num_objects
+            << " objects, threads " << thread_count
+            << dendl;
+  }
+}
+
 /**
 An overview for currently implemented repair logics 
 performed in fsck in two stages: detection(+preparation) and commit.
@@ -11055,9 +11596,11 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
       &used_blocks,
       &used_omap_head,
       &zone_refs,
-      //no need for the below lock when in non-shallow mode as
-      // there is no multithreading in this case
-      depth == FSCK_SHALLOW ? &sb_info_lock : nullptr,
+      //no need for the below lock when in non-shallow mode unless
+      // bluestore_fsck_threads enables multithreading there
+      depth == FSCK_SHALLOW ||
+        cct->_conf.get_val<uint64_t>("bluestore_fsck_threads") > 0 ?
+        &sb_info_lock : nullptr,
       sb_info,
       sb_ref_counts,
       expected_store_statfs,
@@ -11869,6 +12412,8 @@ void BlueStore::inject_global_statfs(const store_statfs_t& new_statfs)
   db->submit_transaction_sync(t);
   // must set these; are needed at _close_db() statfs persisting
   per_pool_stat_collection = false;
+  std::lock_guard l(vstatfs_lock);
+  _fold_statfs();
   vstatfs = new_statfs;
 }
 
@@ -11943,13 +12488,41 @@ void BlueStore::inject_zombie_spanning_blob(coll_t cid, ghobject_t oid,
   db->submit_transaction_sync(txn);
 }
 
-void BlueStore::inject_bluefs_file(std::string_view dir, std::string_view name, size_t new_size)
+void BlueStore::inject_stray_shard_key(coll_t cid, ghobject_t oid)
 {
-  ceph_assert(bluefs);
-
-  BlueFS::FileWriter* p_handle = nullptr;
-  auto ret = bluefs->open_for_write(dir, name, &p_handle, false);
-  ceph_assert(ret == 0);
+  OnodeRef o;
+  CollectionRef c = _get_collection(cid);
+  ceph_assert(c);
+  {
+    std::unique_lock l{ c->lock }; // just to avoid internal asserts
+    o = c->get_onode(oid, false);
+    ceph_assert(o);
+  }
+  ceph_assert(!o->extent_map.shards.empty());
+
+  // copy the first shard to an offset nobody expects; the original has to
+  // stay, a missing shard can't even be faulted in
+  uint32_t offset = o->extent_map.shards.front().shard_info->offset;
+  string key, stray_key;
+  get_extent_shard_key(o->key, offset, &key);
+  get_extent_shard_key(o->key, offset + 1, &stray_key);
+  bufferlist bl;
+  int r = db->get(PREFIX_OBJ, key, &bl);
+  ceph_assert(r >= 0);
+
+  KeyValueDB::Transaction txn;
+  txn = db->get_transaction();
+  txn->set(PREFIX_OBJ, stray_key, bl);
+  db->submit_transaction_sync(txn);
+}
+
+void BlueStore::inject_bluefs_file(std::string_view dir, std::string_view name, size_t new_size)
+{
+  ceph_assert(bluefs);
+
+  BlueFS::FileWriter* p_handle = nullptr;
+  auto ret = bluefs->open_for_write(dir, name, &p_handle, false);
+  ceph_assert(ret == 0);
 
   std::string s(new_size, '0');
   bufferlist bl;
@@ -12160,6 +12733,7 @@ int BlueStore::statfs(struct store_statfs_t *buf,
   _get_statfs_overall(buf);
   {
     std::lock_guard l(vstatfs_lock);
+    _fold_statfs();
     buf->allocated = vstatfs.allocated();
     buf->data_stored = vstatfs.stored();
     buf->data_compressed = vstatfs.compressed();
@@ -12184,6 +12758,7 @@ int BlueStore::pool_statfs(uint64_t pool_id, struct store_statfs_t *buf,
 
   {
     std::lock_guard l(vstatfs_lock);
+    _fold_statfs();
     osd_pools[pool_id].publish(buf);
   }
 
@@ -12265,8 +12840,8 @@ BlueStore::CollectionRef BlueStore::_get_collection_by_oid(const ghobject_t& oid
 void BlueStore::_queue_reap_collection(CollectionRef& c)
 {
   dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-  // _reap_collections and this in the same thread,
-  // so no need a lock.
+  // called from the finalize thread of any kv lane
+  std::lock_guard l(removed_collections_lock);
   removed_collections.push_back(c);
 }
 
@@ -12275,8 +12850,7 @@ void BlueStore::_reap_collections()
 
   list<CollectionRef> removed_colls;
   {
-    // _queue_reap_collection and this in the same thread.
-    // So no need a lock.
+    std::lock_guard l(removed_collections_lock);
     if (!removed_collections.empty())
       removed_colls.swap(removed_collections);
     else
@@ -12306,6 +12880,7 @@ void BlueStore::_reap_collections()
   if (removed_colls.empty()) {
     dout(10) << __func__ << " all reaped" << dendl;
   } else {
+    std::lock_guard l(removed_collections_lock);
     removed_collections.splice(removed_collections.begin(), removed_colls);
   }
 }
@@ -12389,6 +12964,62 @@ bool BlueStore::exists(CollectionHandle &c_, const ghobject_t& oid)
   return r;
 }
 
+void BlueStore::prefetch(CollectionHandle &c_, const vector<ghobject_t>& oids)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  dout(15) << __func__ << " " << c->cid << " " << oids.size() << " objects"
+	   << dendl;
+  if (!c->exists || oids.empty())
+    return;
+
+  std::shared_lock l(c->lock);
+  // load the uncached onodes with a single batched lookup
+  vector<OnodeRef> onodes;
+  onodes.reserve(oids.size());
+  vector<const ghobject_t*> miss;
+  vector<string> keys;
+  for (auto& oid : oids) {
+    OnodeRef o = c->onode_space.lookup(oid);
+    if (o) {
+      onodes.emplace_back(std::move(o));
+    } else {
+      miss.push_back(&oid);
+      keys.emplace_back();
+      get_object_key(cct, oid, &keys.back());
+    }
+  }
+  if (!keys.empty()) {
+    vector<bufferlist> vals;
+    vector<int> rs;
+    db->multi_get(PREFIX_OBJ, keys, &vals, &rs);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (rs[i] < 0) {
+	continue;
+      }
+      OnodeRef o(Onode::create_decode(c, *miss[i], keys[i], vals[i], true,
+				      segment_size != 0));
+      onodes.emplace_back(c->onode_space.add_onode(*miss[i], o));
+      logger->inc(l_bluestore_onode_prefetched);
+    }
+  }
+
+  // omap headers are usually the next thing read, pull them into the
+  // kv cache too
+  map<string, vector<string>> omap_keys;
+  for (auto& o : onodes) {
+    if (o->exists && o->onode.has_omap()) {
+      string key;
+      o->get_omap_header(&key);
+      omap_keys[o->get_omap_prefix()].emplace_back(std::move(key));
+    }
+  }
+  for (auto& [prefix, hkeys] : omap_keys) {
+    vector<bufferlist> vals;
+    vector<int> rs;
+    db->multi_get(prefix, hkeys, &vals, &rs);
+  }
+}
+
 int BlueStore::stat(
   CollectionHandle &c_,
   const ghobject_t& oid,
@@ -12732,6 +13363,9 @@ int BlueStore::_generate_read_result_bl(
   bool* csum_error,
   bufferlist& bl)
 {
+  // everything handed out below is a reference to either a cached Buffer
+  // or the aio read buffer, except zero-filled holes and decompressed data
+  uint64_t copied_bytes = 0;
  // enumerate and decompress desired blobs
   auto p = compressed_blob_bls.begin();
   blobs2read_t::iterator b2r_it = blobs2read.begin();
@@ -12763,6 +13397,7 @@ int BlueStore::_generate_read_result_bl(
         for (auto& r : req.regs) {
           ready_regions[r.logical_offset].substr_of(
             raw_bl, r.blob_xoffset, r.length);
+          copied_bytes += r.length;
         }
       }
     } else {
@@ -12774,8 +13409,9 @@ int BlueStore::_generate_read_result_bl(
         }
 
         // prune and keep result
+        bool cache = buffered && bdev->is_cacheable(req.bl);
         for (const auto& r : req.regs) {
-          if (buffered) {
+          if (cache) {
             bufferlist region_buffer;
             region_buffer.substr_of(req.bl, r.front, r.length);
             // need offset before padding
@@ -12810,12 +13446,17 @@ int BlueStore::_generate_read_result_bl(
                << ": zeros for 0x" << (pos + offset) << "~" << l
                << std::dec << dendl;
       bl.append_zero(l);
+      copied_bytes += l;
       pos += l;
     }
   }
   ceph_assert(bl.length() == length);
   ceph_assert(pos == length);
   ceph_assert(pr == pr_end);
+  // the shared/copied split is only statistics, never fail the read on it
+  copied_bytes = std::min<uint64_t>(copied_bytes, length);
+  logger->inc(l_bluestore_read_shared_bytes, length - copied_bytes);
+  logger->inc(l_bluestore_read_copied_bytes, copied_bytes);
   return 0;
 }
 
@@ -13811,15 +14452,20 @@ int BlueStore::omap_get_values(
   {
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
-    size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-      final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
+    vector<string> db_keys;
+    db_keys.reserve(keys.size());
+    for (auto& k : keys) {
+      db_keys.emplace_back(final_key + k);
+    }
+    vector<bufferlist> vals;
+    vector<int> rs;
+    db->multi_get(prefix, db_keys, &vals, &rs);
+    auto p = keys.begin();
+    for (size_t i = 0; i < db_keys.size(); ++i, ++p) {
+      if (rs[i] >= 0) {
+	dout(30) << __func__ << "  got " << pretty_binary_string(db_keys[i])
 		 << " -> " << *p << dendl;
-	out->insert(make_pair(*p, val));
+	out->emplace_hint(out->end(), *p, std::move(vals[i]));
       }
     }
   }
@@ -13861,17 +14507,22 @@ int BlueStore::omap_check_keys(
   {
     const string& prefix = o->get_omap_prefix();
     o->get_omap_key(string(), &final_key);
-    size_t base_key_len = final_key.size();
-    for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-      final_key.resize(base_key_len); // keep prefix
-      final_key += *p;
-      bufferlist val;
-      if (db->get(prefix, final_key, &val) >= 0) {
-	dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
+    vector<string> db_keys;
+    db_keys.reserve(keys.size());
+    for (auto& k : keys) {
+      db_keys.emplace_back(final_key + k);
+    }
+    vector<bufferlist> vals;
+    vector<int> rs;
+    db->multi_get(prefix, db_keys, &vals, &rs);
+    auto p = keys.begin();
+    for (size_t i = 0; i < db_keys.size(); ++i, ++p) {
+      if (rs[i] >= 0) {
+	dout(30) << __func__ << "  have " << pretty_binary_string(db_keys[i])
 		 << " -> " << *p << dendl;
 	out->insert(*p);
       } else {
-	dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
+	dout(30) << __func__ << "  miss " << pretty_binary_string(db_keys[i])
 		 << " -> " << *p << dendl;
       }
     }
@@ -14283,25 +14934,46 @@ void BlueStore::_txc_update_store_statfs(TransContext *txc)
       txc->t->merge(PREFIX_STAT, key, bl);
     }
 
-    std::lock_guard l(vstatfs_lock);
-    auto& stats = osd_pools[txc->osd_pool_id];
-    stats += txc->statfs_delta;
-    
-    vstatfs += txc->statfs_delta; //non-persistent in this mode
-
+    if (!txc->pool_statfs) {
+      txc->pool_statfs = _get_pool_statfs_pending(txc->osd_pool_id);
+    }
+    txc->pool_statfs->add(txc->statfs_delta);
   } else {
     if (!is_statfs_recoverable()) {
       bufferlist bl;
       txc->statfs_delta.encode(bl);
       txc->t->merge(PREFIX_STAT, BLUESTORE_GLOBAL_STATFS_KEY, bl);
     }
-
-    std::lock_guard l(vstatfs_lock);
-    vstatfs += txc->statfs_delta;
-  } 
+  }
+  // non-persistent in per-pool mode
+  vstatfs_pending.add(txc->statfs_delta);
   txc->statfs_delta.reset();
 }
 
+BlueStore::statfs_accumulator_t* BlueStore::_get_pool_statfs_pending(
+  uint64_t pool_id)
+{
+  std::lock_guard l(vstatfs_lock);
+  auto& p = osd_pools_pending[pool_id];
+  if (!p) {
+    p = std::make_unique<statfs_accumulator_t>();
+  }
+  return p.get();
+}
+
+void BlueStore::_fold_statfs()
+{
+  ceph_assert(ceph_mutex_is_locked(vstatfs_lock));
+  vstatfs_pending.drain(&vstatfs);
+  for (auto& [pool_id, pending] : osd_pools_pending) {
+    volatile_statfs delta;
+    pending->drain(&delta);
+    if (!delta.is_empty()) {
+      osd_pools[pool_id] += delta;
+    }
+  }
+}
+
 void BlueStore::_txc_state_proc(TransContext *txc)
 {
   while (true) {
@@ -14371,20 +15043,18 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	}
       }
       {
-	std::lock_guard l(kv_lock);
-	kv_queue.push_back(txc);
-	if (!kv_sync_in_progress) {
-	  kv_sync_in_progress = true;
-	  kv_cond.notify_one();
-	}
+	KVSyncLane& lane = _get_kv_lane(txc->osr.get());
+	std::lock_guard l(lane.kv_lock);
+	lane.kv_queue.push_back(txc);
+	lane.wake_sync();
 	if (txc->get_state() != TransContext::STATE_KV_SUBMITTED) {
-	  kv_queue_unsubmitted.push_back(txc);
+	  lane.kv_queue_unsubmitted.push_back(txc);
 	  ++txc->osr->kv_committing_serially;
 	}
 	if (txc->had_ios)
-	  kv_ios++;
-	kv_throttle_costs += txc->cost;
-	++kv_throttle_txcs;
+	  lane.kv_ios++;
+	lane.kv_throttle_costs += txc->cost;
+	++lane.kv_throttle_txcs;
       }
       return;
     case TransContext::STATE_KV_SUBMITTED:
@@ -14565,6 +15235,9 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
 	       << "~" << p.get_len() << std::dec << dendl;
       fm->release(p.get_start(), p.get_len(), t);
     }
+  } else if (alloc_journal_enabled &&
+	     (!txc->allocated.empty() || !txc->released.empty())) {
+    _txc_journal_alloc(txc, t);
   }
 
   _txc_update_store_statfs(txc);
@@ -14811,11 +15484,9 @@ void BlueStore::_osr_drain_preceding(TransContext *txc)
   }
   {
     // wake up any previously finished deferred events
-    std::lock_guard l(kv_lock);
-    if (!kv_sync_in_progress) {
-      kv_sync_in_progress = true;
-      kv_cond.notify_one();
-    }
+    KVSyncLane& lane = _get_kv_lane(osr);
+    std::lock_guard l(lane.kv_lock);
+    lane.wake_sync();
   }
   osr->drain_preceding(txc);
   --deferred_aggressive;
@@ -14837,11 +15508,9 @@ void BlueStore::_osr_drain(OpSequencer *osr)
   }
   {
     // wake up any previously finished deferred events
-    std::lock_guard l(kv_lock);
-    if (!kv_sync_in_progress) {
-      kv_sync_in_progress = true;
-      kv_cond.notify_one();
-    }
+    KVSyncLane& lane = _get_kv_lane(osr);
+    std::lock_guard l(lane.kv_lock);
+    lane.wake_sync();
   }
   osr->drain();
   --deferred_aggressive;
@@ -14874,15 +15543,8 @@ void BlueStore::_osr_drain_all()
     // submit anything pending
     deferred_try_submit();
   }
-  {
-    // wake up any previously finished deferred events
-    std::lock_guard l(kv_lock);
-    kv_cond.notify_one();
-  }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_cond.notify_one();
-  }
+  // wake up any previously finished deferred events
+  _kv_wake_all_lanes();
   for (auto osr : s) {
     dout(20) << __func__ << " drain " << osr << dendl;
     osr->drain();
@@ -14912,57 +15574,222 @@ void BlueStore::_osr_drain_all()
 
 void BlueStore::_kv_start()
 {
-  dout(10) << __func__ << dendl;
+  uint64_t num_lanes = cct->_conf.get_val<uint64_t>("bluestore_kv_sync_lanes");
+  dout(10) << __func__ << " lanes " << num_lanes << dendl;
 
   finisher.start();
-  kv_sync_thread.create("bstore_kv_sync");
-  kv_finalize_thread.create("bstore_kv_final");
+  alloc_journal_finisher.start();
+  kv_lanes.clear();
+  for (uint32_t i = 0; i < num_lanes; ++i) {
+    kv_lanes.emplace_back(std::make_unique<KVSyncLane>(this, i));
+  }
+  for (auto& lane : kv_lanes) {
+    if (lane->id == 0) {
+      lane->kv_sync_thread.create("bstore_kv_sync");
+      lane->kv_finalize_thread.create("bstore_kv_final");
+    } else {
+      // keep within the 15 char thread name limit
+      lane->kv_sync_thread.create(
+	("bstore_kvs_" + std::to_string(lane->id)).c_str());
+      lane->kv_finalize_thread.create(
+	("bstore_kvf_" + std::to_string(lane->id)).c_str());
+    }
+  }
 }
 
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
-  {
-    std::unique_lock l{kv_lock};
-    while (!kv_sync_started) {
-      kv_cond.wait(l);
+  for (auto& lane : kv_lanes) {
+    {
+      std::unique_lock l{lane->kv_lock};
+      while (!lane->kv_sync_started) {
+	lane->kv_cond.wait(l);
+      }
+      lane->kv_stop = true;
+      lane->kv_cond.notify_all();
     }
-    kv_stop = true;
-    kv_cond.notify_all();
-  }
-  {
-    std::unique_lock l{kv_finalize_lock};
-    while (!kv_finalize_started) {
-      kv_finalize_cond.wait(l);
+    {
+      std::unique_lock l{lane->kv_finalize_lock};
+      while (!lane->kv_finalize_started) {
+	lane->kv_finalize_cond.wait(l);
+      }
+      lane->kv_finalize_stop = true;
+      lane->kv_finalize_cond.notify_all();
     }
-    kv_finalize_stop = true;
-    kv_finalize_cond.notify_all();
   }
-  kv_sync_thread.join();
-  kv_finalize_thread.join();
-  ceph_assert(removed_collections.empty());
-  {
-    std::lock_guard l(kv_lock);
-    kv_stop = false;
+  for (auto& lane : kv_lanes) {
+    lane->kv_sync_thread.join();
+    lane->kv_finalize_thread.join();
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_stop = false;
+  ceph_assert(removed_collections.empty());
+  for (auto& lane : kv_lanes) {
+    {
+      std::lock_guard l(lane->kv_lock);
+      lane->kv_stop = false;
+    }
+    {
+      std::lock_guard l(lane->kv_finalize_lock);
+      lane->kv_finalize_stop = false;
+    }
   }
   dout(10) << __func__ << " stopping finishers" << dendl;
   finisher.wait_for_empty();
   finisher.stop();
+  alloc_journal_finisher.wait_for_empty();
+  alloc_journal_finisher.stop();
   dout(10) << __func__ << " stopped" << dendl;
 }
 
-void BlueStore::_kv_sync_thread()
+struct BlueStore::CompressBatch {
+  std::vector<CompressJob>& jobs;
+  size_t end = 0;               ///< jobs [0, end) were admitted to the pool
+  std::atomic<size_t> next = {0};
+  size_t done = 0;              ///< protected by compress_lock
+
+  explicit CompressBatch(std::vector<CompressJob>& j) : jobs(j) {}
+};
+
+void BlueStore::_compress_start()
 {
-  dout(10) << __func__ << " start" << dendl;
+  uint64_t num = cct->_conf.get_val<uint64_t>("bluestore_compression_threads");
+  compress_queue_max =
+    cct->_conf.get_val<uint64_t>("bluestore_compression_queue_max");
+  dout(10) << __func__ << " threads " << num
+	   << " queue_max " << compress_queue_max << dendl;
+  for (uint64_t i = 0; i < num; ++i) {
+    compress_threads.emplace_back(std::make_unique<CompressThread>(this));
+    compress_threads.back()->create(
+      ("bstore_comp_" + std::to_string(i)).c_str());
+  }
+}
+
+void BlueStore::_compress_stop()
+{
+  if (compress_threads.empty()) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(compress_lock);
+    compress_stop = true;
+    compress_cond.notify_all();
+  }
+  for (auto& t : compress_threads) {
+    t->join();
+  }
+  compress_threads.clear();
+  std::lock_guard l(compress_lock);
+  ceph_assert(compress_queue.empty());
+  ceph_assert(compress_queued == 0);
+  compress_stop = false;
+}
+
+void BlueStore::_compress_run(CompressJob& job)
+{
+  auto start = mono_clock::now();
+  job.r = job.compressor->compress(*job.in, job.out, job.compressor_message);
+  job.lat = mono_clock::now() - start;
+}
+
+void BlueStore::_compress_thread()
+{
+  std::unique_lock l(compress_lock);
+  while (true) {
+    if (compress_queue.empty()) {
+      if (compress_stop) {
+	break;
+      }
+      compress_cond.wait(l);
+      continue;
+    }
+    CompressBatch *b = compress_queue.front();
+    // claim under compress_lock: the submitter unlinks its batch under the
+    // same lock, so a batch still queued here is alive
+    size_t i = b->next++;
+    if (i + 1 >= b->end) {
+      compress_queue.pop_front();
+    }
+    if (i >= b->end) {
+      continue;
+    }
+    l.unlock();
+    _compress_run(b->jobs[i]);
+    l.lock();
+    --compress_queued;
+    if (++b->done == b->end) {
+      compress_done_cond.notify_all();
+    }
+  }
+}
+
+void BlueStore::_compress_jobs(std::vector<CompressJob>& jobs, bool may_skip)
+{
+  if (compress_threads.empty() || jobs.size() < 2) {
+    for (auto& job : jobs) {
+      _compress_run(job);
+    }
+    return;
+  }
+  CompressBatch b(jobs);
+  {
+    std::lock_guard l(compress_lock);
+    b.end = jobs.size();
+    if (may_skip) {
+      uint64_t room = compress_queued < compress_queue_max ?
+	compress_queue_max - compress_queued : 0;
+      b.end = std::min<uint64_t>(b.end, room);
+    }
+    if (b.end) {
+      compress_queued += b.end;
+      compress_queue.push_back(&b);
+      compress_cond.notify_all();
+    }
+  }
+  if (b.end) {
+    logger->inc(l_bluestore_compress_pool_queued, b.end);
+  }
+  for (size_t i = b.end; i < jobs.size(); ++i) {
+    jobs[i].r = -EBUSY;
+  }
+  // rather than idle while waiting, take our share of the batch
+  size_t mine = 0;
+  for (size_t i = b.next++; i < b.end; i = b.next++) {
+    _compress_run(jobs[i]);
+    ++mine;
+  }
+  std::unique_lock l(compress_lock);
+  auto p = std::find(compress_queue.begin(), compress_queue.end(), &b);
+  if (p != compress_queue.end()) {
+    compress_queue.erase(p);
+  }
+  compress_queued -= mine;
+  b.done += mine;
+  compress_done_cond.wait(l, [&] { return b.done == b.end; });
+}
+
+void BlueStore::_kv_wake_all_lanes()
+{
+  for (auto& lane : kv_lanes) {
+    {
+      std::lock_guard l(lane->kv_lock);
+      lane->kv_cond.notify_one();
+    }
+    {
+      std::lock_guard l(lane->kv_finalize_lock);
+      lane->kv_finalize_cond.notify_one();
+    }
+  }
+}
+
+void BlueStore::_kv_sync_thread(KVSyncLane& lane)
+{
+  dout(10) << __func__ << " lane " << lane.id << " start" << dendl;
   deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
-  std::unique_lock l{kv_lock};
-  ceph_assert(!kv_sync_started);
-  kv_sync_started = true;
-  kv_cond.notify_all();
+  std::unique_lock l{lane.kv_lock};
+  ceph_assert(!lane.kv_sync_started);
+  lane.kv_sync_started = true;
+  lane.kv_cond.notify_all();
 
   auto t0 = mono_clock::now();
   timespan twait = ceph::make_timespan(0);
@@ -14974,7 +15801,7 @@ void BlueStore::_kv_sync_thread()
       ceph::make_timespan(period);
     auto elapsed = mono_clock::now() - t0;
     if (period && elapsed >= observation_period) {
-      dout(5) << __func__ << " utilization: idle "
+      dout(5) << __func__ << " lane " << lane.id << " utilization: idle "
 	      << twait << " of " << elapsed
 	      << ", submitted: " << kv_submitted
 	      <<dendl;
@@ -14982,16 +15809,17 @@ void BlueStore::_kv_sync_thread()
       twait = ceph::make_timespan(0);
       kv_submitted = 0;
     }
+    auto& kv_committing = lane.kv_committing;
     ceph_assert(kv_committing.empty());
-    if (kv_queue.empty() &&
-	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
+    if (lane.kv_queue.empty() &&
+	((lane.deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
 	 !deferred_aggressive)) {
-      if (kv_stop)
+      if (lane.kv_stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
       auto t = mono_clock::now();
-      kv_sync_in_progress = false;
-      kv_cond.wait(l);
+      lane.kv_sync_in_progress = false;
+      lane.kv_cond.wait(l);
       twait += mono_clock::now() - t;
 
       dout(20) << __func__ << " wake" << dendl;
@@ -15000,21 +15828,22 @@ void BlueStore::_kv_sync_thread()
       deque<DeferredBatch*> deferred_done, deferred_stable;
       uint64_t aios = 0, costs = 0, txcs = 0;
 
-      dout(20) << __func__ << " committing " << kv_queue.size()
-	       << " submitting " << kv_queue_unsubmitted.size()
-	       << " deferred done " << deferred_done_queue.size()
+      dout(20) << __func__ << " lane " << lane.id
+	       << " committing " << lane.kv_queue.size()
+	       << " submitting " << lane.kv_queue_unsubmitted.size()
+	       << " deferred done " << lane.deferred_done_queue.size()
 	       << " stable " << deferred_stable_queue.size()
 	       << dendl;
-      kv_committing.swap(kv_queue);
-      kv_submitting.swap(kv_queue_unsubmitted);
-      deferred_done.swap(deferred_done_queue);
+      kv_committing.swap(lane.kv_queue);
+      kv_submitting.swap(lane.kv_queue_unsubmitted);
+      deferred_done.swap(lane.deferred_done_queue);
       deferred_stable.swap(deferred_stable_queue);
-      aios = kv_ios;
-      costs = kv_throttle_costs;
-      txcs = kv_throttle_txcs;
-      kv_ios = 0;
-      kv_throttle_costs = 0;
-      kv_throttle_txcs = 0;
+      aios = lane.kv_ios;
+      costs = lane.kv_throttle_costs;
+      txcs = lane.kv_throttle_txcs;
+      lane.kv_ios = 0;
+      lane.kv_throttle_costs = 0;
+      lane.kv_throttle_txcs = 0;
       l.unlock();
 
       dout(30) << __func__ << " committing " << kv_committing << dendl;
@@ -15070,8 +15899,22 @@ void BlueStore::_kv_sync_thread()
       // case where we are approaching the max and the case we passed
       // it.  in either case, we increase the max in the earlier txn
       // we submit.
+      //
+      // with several lanes the new max values must hit the disk in the
+      // same order they are published, so the lane raising them holds
+      // kv_prealloc_lock until its commit is done.  the check is redone
+      // under the lock because another lane may have raised them already;
+      // the unlocked pre-check only reads the atomics and is just a hint.
+      std::unique_lock prealloc_l{kv_prealloc_lock, std::defer_lock};
+      if (nid_last.load() + cct->_conf->bluestore_nid_prealloc/2 >
+	    nid_max.load() ||
+	  blobid_last.load() + cct->_conf->bluestore_blobid_prealloc/2 >
+	    blobid_max.load()) {
+	prealloc_l.lock();
+      }
       uint64_t new_nid_max = 0, new_blobid_max = 0;
-      if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
+      if (prealloc_l.owns_lock() &&
+	  nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
 	KeyValueDB::Transaction t =
 	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
 	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
@@ -15080,7 +15923,8 @@ void BlueStore::_kv_sync_thread()
 	t->set(PREFIX_SUPER, "nid_max", bl);
 	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
       }
-      if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
+      if (prealloc_l.owns_lock() &&
+	  blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
 	KeyValueDB::Transaction t =
 	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
 	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
@@ -15161,28 +16005,28 @@ void BlueStore::_kv_sync_thread()
 #endif
 
       {
-	std::unique_lock m{kv_finalize_lock};
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
+	std::unique_lock m{lane.kv_finalize_lock};
+	if (lane.kv_committing_to_finalize.empty()) {
+	  lane.kv_committing_to_finalize.swap(kv_committing);
 	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
+	  lane.kv_committing_to_finalize.insert(
+	      lane.kv_committing_to_finalize.end(),
 	      kv_committing.begin(),
 	      kv_committing.end());
 	  kv_committing.clear();
 	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
+	if (lane.deferred_stable_to_finalize.empty()) {
+	  lane.deferred_stable_to_finalize.swap(deferred_stable);
 	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
+	  lane.deferred_stable_to_finalize.insert(
+	      lane.deferred_stable_to_finalize.end(),
 	      deferred_stable.begin(),
 	      deferred_stable.end());
 	  deferred_stable.clear();
 	}
-	if (!kv_finalize_in_progress) {
-	  kv_finalize_in_progress = true;
-	  kv_finalize_cond.notify_one();
+	if (!lane.kv_finalize_in_progress) {
+	  lane.kv_finalize_in_progress = true;
+	  lane.kv_finalize_cond.notify_one();
 	}
       }
 
@@ -15194,6 +16038,9 @@ void BlueStore::_kv_sync_thread()
 	blobid_max = new_blobid_max;
 	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
       }
+      if (prealloc_l.owns_lock()) {
+	prealloc_l.unlock();
+      }
 
       {
 	auto finish = mono_clock::now();
@@ -15225,33 +16072,33 @@ void BlueStore::_kv_sync_thread()
       deferred_stable_queue.swap(deferred_done);
     }
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_sync_started = false;
+  dout(10) << __func__ << " lane " << lane.id << " finish" << dendl;
+  lane.kv_sync_started = false;
 }
 
-void BlueStore::_kv_finalize_thread()
+void BlueStore::_kv_finalize_thread(KVSyncLane& lane)
 {
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
-  dout(10) << __func__ << " start" << dendl;
-  std::unique_lock l(kv_finalize_lock);
-  ceph_assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
+  dout(10) << __func__ << " lane " << lane.id << " start" << dendl;
+  std::unique_lock l(lane.kv_finalize_lock);
+  ceph_assert(!lane.kv_finalize_started);
+  lane.kv_finalize_started = true;
+  lane.kv_finalize_cond.notify_all();
   while (true) {
     ceph_assert(kv_committed.empty());
     ceph_assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
+    if (lane.kv_committing_to_finalize.empty() &&
+	lane.deferred_stable_to_finalize.empty()) {
+      if (lane.kv_finalize_stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_in_progress = false;
-      kv_finalize_cond.wait(l);
+      lane.kv_finalize_in_progress = false;
+      lane.kv_finalize_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
+      kv_committed.swap(lane.kv_committing_to_finalize);
+      deferred_stable.swap(lane.deferred_stable_to_finalize);
       l.unlock();
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
@@ -15293,8 +16140,8 @@ void BlueStore::_kv_finalize_thread()
       l.lock();
     }
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
+  dout(10) << __func__ << " lane " << lane.id << " finish" << dendl;
+  lane.kv_finalize_started = false;
 }
 
 
@@ -15369,11 +16216,18 @@ void BlueStore::deferred_try_submit()
     }
   }
 
+  bool coalesce = osrs.size() > 1 &&
+    cct->_conf.get_val<bool>("bluestore_deferred_coalesce");
+  vector<DeferredBatch*> batches;
   for (auto& osr : osrs) {
     osr->deferred_lock.lock();
     if (osr->deferred_pending) {
       if (!osr->deferred_running) {
-	_deferred_submit_unlock(osr.get());
+	if (coalesce) {
+	  batches.push_back(_deferred_detach_unlock(osr.get()));
+	} else {
+	  _deferred_submit_unlock(osr.get());
+	}
       } else {
 	osr->deferred_lock.unlock();
 	dout(20) << __func__ << "  osr " << osr << " already has running"
@@ -15384,6 +16238,9 @@ void BlueStore::deferred_try_submit()
       dout(20) << __func__ << "  osr " << osr << " has no pending" << dendl;
     }
   }
+  if (!batches.empty()) {
+    _deferred_submit_coalesced(batches);
+  }
 
   {
     std::lock_guard l(deferred_lock);
@@ -15391,7 +16248,7 @@ void BlueStore::deferred_try_submit()
   }
 }
 
-void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
+BlueStore::DeferredBatch *BlueStore::_deferred_detach_unlock(OpSequencer *osr)
 {
   dout(10) << __func__ << " osr " << osr
 	   << " " << osr->deferred_pending->iomap.size() << " ios pending "
@@ -15411,6 +16268,92 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     throttle.log_state_latency(txc, logger, l_bluestore_state_deferred_queued_lat);
   }
+  return b;
+}
+
+void BlueStore::_deferred_submit_coalesced(vector<DeferredBatch*>& batches)
+{
+  // Merge the ios of all batches that don't overlap each other into one
+  // offset ordered map.  Overlapping batches (which may only happen when
+  // space freed by one sequencer got reused by another) keep their own
+  // submission so that per-batch write ordering is preserved.
+  DeferredGroup *g = new DeferredGroup(cct);
+  interval_set<uint64_t> covered;
+  map<uint64_t, bufferlist> iomap;
+  for (auto b : batches) {
+    bool overlaps = false;
+    for (auto& [off, io] : b->iomap) {
+      if (covered.intersects(off, io.bl.length())) {
+	overlaps = true;
+	break;
+      }
+    }
+    if (overlaps) {
+      dout(20) << __func__ << " osr " << b->osr << " overlaps, separate submit"
+	       << dendl;
+      _deferred_submit_batch(b);
+      continue;
+    }
+    for (auto& [off, io] : b->iomap) {
+      covered.union_insert(off, io.bl.length());
+      iomap[off] = std::move(io.bl);
+    }
+    g->batches.push_back(b);
+  }
+  if (g->batches.empty()) {
+    delete g;
+    return;
+  }
+
+  // build runs of adjacent ios, up to the max merge size each
+  uint64_t max_merge = cct->_conf.get_val<Option::size_t>(
+    "bluestore_deferred_max_merge_size");
+  vector<pair<uint64_t, bufferlist>> runs;
+  for (auto& [off, bl] : iomap) {
+    if (runs.empty() ||
+	runs.back().first + runs.back().second.length() != off ||
+	(max_merge &&
+	 runs.back().second.length() + bl.length() > max_merge)) {
+      runs.emplace_back(off, bufferlist());
+    }
+    runs.back().second.claim_append(bl);
+  }
+  // elevator: alternate the sweep direction between submissions
+  bool up = deferred_elevator_up.fetch_xor(1);
+  if (!up) {
+    std::reverse(runs.begin(), runs.end());
+  }
+  dout(10) << __func__ << " " << g->batches.size() << " batches, "
+	   << iomap.size() << " ios -> " << runs.size() << " writes "
+	   << (up ? "ascending" : "descending") << dendl;
+  for (auto& [start, bl] : runs) {
+    dout(20) << __func__ << " write 0x" << std::hex
+	     << start << "~" << bl.length() << std::dec << dendl;
+    if (!g_conf()->bluestore_debug_omit_block_device_write) {
+      logger->inc(l_bluestore_submitted_deferred_writes);
+      logger->inc(l_bluestore_submitted_deferred_write_bytes, bl.length());
+      int r = bdev->aio_write(start, bl, &g->ioc, false);
+      ceph_assert(r == 0);
+    }
+  }
+  bdev->aio_submit(&g->ioc);
+}
+
+void BlueStore::DeferredGroup::aio_finish(BlueStore *store)
+{
+  for (auto b : batches) {
+    store->_deferred_aio_finish(b->osr);
+  }
+  delete this;
+}
+
+void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
+{
+  _deferred_submit_batch(_deferred_detach_unlock(osr));
+}
+
+void BlueStore::_deferred_submit_batch(DeferredBatch *b)
+{
   uint64_t start = 0, pos = 0;
   bufferlist bl;
   auto i = b->iomap.begin();
@@ -15500,14 +16443,14 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
   }
 
   {
-    std::lock_guard l(kv_lock);
-    deferred_done_queue.emplace_back(b);
+    KVSyncLane& lane = _get_kv_lane(b->osr);
+    std::lock_guard l(lane.kv_lock);
+    lane.deferred_done_queue.emplace_back(b);
 
     // in the normal case, do not bother waking up the kv thread; it will
     // catch us on the next commit anyway.
-    if (deferred_aggressive && !kv_sync_in_progress) {
-	kv_sync_in_progress = true;
-	kv_cond.notify_one();
+    if (deferred_aggressive) {
+      lane.wake_sync();
     }
   }
 }
@@ -15708,11 +16651,9 @@ int BlueStore::queue_transactions(
     deferred_try_submit();
     {
       // wake up any previously finished deferred events
-      std::lock_guard l(kv_lock);
-      if (!kv_sync_in_progress) {
-	kv_sync_in_progress = true;
-	kv_cond.notify_one();
-      }
+      KVSyncLane& lane = _get_kv_lane(txc->osr.get());
+      std::lock_guard l(lane.kv_lock);
+      lane.wake_sync();
     }
     throttle.finish_start_transaction(*db, *txc, tstart);
     --deferred_aggressive;
@@ -15796,6 +16737,14 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
       ceph_assert(txc->osd_pool_id == META_POOL_ID ||
                   txc->osd_pool_id == pgid.pool());
       txc->osd_pool_id = pgid.pool();
+      if (!txc->pool_statfs) {
+	auto pool_statfs = c->pool_statfs.load(std::memory_order_relaxed);
+	if (!pool_statfs) {
+	  pool_statfs = _get_pool_statfs_pending(pgid.pool());
+	  c->pool_statfs.store(pool_statfs, std::memory_order_relaxed);
+	}
+	txc->pool_statfs = pool_statfs;
+      }
     }
 
     switch (op->op) {
@@ -16978,18 +17927,36 @@ int BlueStore::_do_alloc_write(
   // and the condition is : (data_size < deferred).
 
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
+  std::vector<CompressJob> compress_jobs;
+  if (wctx->compressor) {
+    for (auto& wi : wctx->writes) {
+      if (wi.blob_length > min_alloc_size) {
+	ceph_assert(wi.b_off == 0);
+	ceph_assert(wi.blob_length == wi.bl.length());
+	compress_jobs.emplace_back(wctx->compressor, &wi.bl);
+      }
+    }
+    // compress
+    _compress_jobs(compress_jobs, true);
+  }
+  auto compress_job = compress_jobs.begin();
   for (auto& wi : wctx->writes) {
     if (wctx->compressor && wi.blob_length > min_alloc_size) {
-      auto start = mono_clock::now();
-
-      // compress
-      ceph_assert(wi.b_off == 0);
-      ceph_assert(wi.blob_length == wi.bl.length());
+      CompressJob& job = *compress_job++;
+      if (job.r == -EBUSY) {
+	dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
+		 << " compression pool saturated, leaving uncompressed"
+		 << std::dec << dendl;
+	logger->inc(l_bluestore_compress_pool_skipped);
+	need += wi.blob_length;
+	data_size += wi.bl.length();
+	continue;
+      }
 
       // FIXME: memory alignment here is bad
-      bufferlist t;
-      std::optional<int32_t> compressor_message;
-      int r = wctx->compressor->compress(wi.bl, t, compressor_message);
+      bufferlist& t = job.out;
+      std::optional<int32_t>& compressor_message = job.compressor_message;
+      int r = job.r;
       uint64_t want_len_raw = wi.blob_length * wctx->crr;
       uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
       bool rejected = false;
@@ -17055,7 +18022,7 @@ int BlueStore::_do_alloc_write(
       }
       log_latency("compress@_do_alloc_write",
 	l_bluestore_compress_lat,
-        mono_clock::now() - start,
+	job.lat,
 	cct->_conf->bluestore_log_op_age );
     } else {
       need += wi.blob_length;
@@ -20449,6 +21416,293 @@ int BlueStore::restore_allocator(Allocator* dest_allocator, uint64_t *num, uint6
   return ret;
 }
 
+//-----------------------------------------------------------------------------------
+// Allocation journal (NCB mode, bluestore_allocation_journal=true)
+//
+// The allocation file is only valid after a clean shutdown.  To avoid the full
+// onode scan after a crash we keep, under PREFIX_ALLOC_JOURNAL:
+//   "B" + u64 chunk -> free extents of the BlueStore-only view (the same view the
+//                      allocation file holds; BlueFS space and label copies are
+//                      accounted elsewhere) within the chunk's slice of the device
+//   "E" + u64 seq   -> allocated/released sets of a single txc, written within
+//                      the txc's own kv transaction
+//   "H"             -> number of base chunks + device size
+// The base is rewritten on every mount.  Checkpoints fold the journal into the
+// base chunks its entries touch, off the mempool thread.  Replay is order
+// independent for disjoint extents and conflicting extents are always committed
+// in seq order (space is handed back to the allocator only after the releasing
+// txc commits).
+static const std::string ALLOC_JOURNAL_HEADER_KEY = "H";
+static const char ALLOC_JOURNAL_BASE_PREFIX = 'B';
+static const char ALLOC_JOURNAL_ENTRY_PREFIX = 'E';
+static const uint64_t ALLOC_JOURNAL_CHUNK_SPAN = 256ull << 20;
+
+static std::string alloc_journal_chunk_key(uint64_t chunk)
+{
+  std::string key;
+  key.push_back(ALLOC_JOURNAL_BASE_PREFIX);
+  _key_encode_u64(chunk, &key);
+  return key;
+}
+
+void BlueStore::_txc_journal_alloc(TransContext *txc, KeyValueDB::Transaction t)
+{
+  std::string key;
+  key.push_back(ALLOC_JOURNAL_ENTRY_PREFIX);
+  _key_encode_u64(++alloc_journal_seq, &key);
+  bufferlist bl;
+  encode(txc->allocated, bl);
+  encode(txc->released, bl);
+  t->set(PREFIX_ALLOC_JOURNAL, key, bl);
+  ++alloc_journal_pending;
+  logger->inc(l_bluestore_alloc_journal_entries);
+}
+
+void BlueStore::_alloc_journal_write_chunk(KeyValueDB::Transaction t,
+					   uint64_t chunk,
+					   const alloc_journal_set_t& free)
+{
+  uint64_t begin = chunk * ALLOC_JOURNAL_CHUNK_SPAN;
+  uint64_t end = begin + ALLOC_JOURNAL_CHUNK_SPAN;
+  uint32_t count = 0;
+  bufferlist bl;
+  for (auto p = free.lower_bound(begin);
+       p != free.end() && p.get_start() < end;
+       ++p) {
+    uint64_t s = std::max(p.get_start(), begin);
+    uint64_t e = std::min(p.get_end(), end);
+    encode(s, bl);
+    encode(e - s, bl);
+    ++count;
+  }
+  bufferlist cbl;
+  encode(count, cbl);
+  cbl.claim_append(bl);
+  t->set(PREFIX_ALLOC_JOURNAL, alloc_journal_chunk_key(chunk), cbl);
+}
+
+void BlueStore::_alloc_journal_write_base(KeyValueDB::Transaction t,
+					  const alloc_journal_set_t& free)
+{
+  // every chunk is written, empty or not, so that the header can tell a
+  // complete base apart from a partial one
+  uint64_t chunks = p2roundup(bdev->get_size(), ALLOC_JOURNAL_CHUNK_SPAN) /
+    ALLOC_JOURNAL_CHUNK_SPAN;
+  for (uint64_t chunk = 0; chunk < chunks; ++chunk) {
+    _alloc_journal_write_chunk(t, chunk, free);
+  }
+  bufferlist hbl;
+  encode(chunks, hbl);
+  encode(bdev->get_size(), hbl);
+  t->set(PREFIX_ALLOC_JOURNAL, ALLOC_JOURNAL_HEADER_KEY, hbl);
+  dout(10) << __func__ << " " << free.num_intervals() << " extents in "
+	   << chunks << " chunks" << dendl;
+}
+
+int BlueStore::_alloc_journal_load(alloc_journal_set_t *free,
+				   uint64_t *entries)
+{
+  // a single iterator gives us a consistent snapshot of base + journal
+  auto it = db->get_iterator(PREFIX_ALLOC_JOURNAL, KeyValueDB::ITERATOR_NOCACHE);
+  uint64_t chunks = 0, want_chunks = 0, size = 0;
+  bool have_header = false;
+  *entries = 0;
+  try {
+    for (it->lower_bound(string()); it->valid(); it->next()) {
+      std::string key = it->key();
+      bufferlist bl = it->value();
+      auto p = bl.cbegin();
+      if (key == ALLOC_JOURNAL_HEADER_KEY) {
+	decode(want_chunks, p);
+	decode(size, p);
+	have_header = true;
+      } else if (key[0] == ALLOC_JOURNAL_BASE_PREFIX) {
+	uint32_t count;
+	decode(count, p);
+	while (count--) {
+	  uint64_t offset, length;
+	  decode(offset, p);
+	  decode(length, p);
+	  free->union_insert(offset, length);
+	}
+	++chunks;
+      } else if (key[0] == ALLOC_JOURNAL_ENTRY_PREFIX) {
+	// base chunks sort before journal entries so the base is complete here
+	interval_set<uint64_t> allocated, released;
+	decode(allocated, p);
+	decode(released, p);
+	for (auto q = allocated.begin(); q != allocated.end(); ++q) {
+	  free->erase(q.get_start(), q.get_len());
+	}
+	for (auto q = released.begin(); q != released.end(); ++q) {
+	  free->union_insert(q.get_start(), q.get_len());
+	}
+	++(*entries);
+      } else {
+	derr << __func__ << " unexpected key " << pretty_binary_string(key)
+	     << dendl;
+	return -EIO;
+      }
+    }
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << " failed to decode: " << e.what() << dendl;
+    return -EIO;
+  }
+  if (!have_header || chunks != want_chunks || size > bdev->get_size()) {
+    dout(1) << __func__ << " no usable base, header " << have_header
+	    << " chunks " << chunks << "/" << want_chunks
+	    << " size 0x" << std::hex << size << std::dec << dendl;
+    return -ENOENT;
+  }
+  return 0;
+}
+
+int BlueStore::_restore_allocator_from_journal(Allocator* dest_allocator,
+					       uint64_t *num, uint64_t *bytes)
+{
+  utime_t start = ceph_clock_now();
+  alloc_journal_set_t free;
+  uint64_t entries = 0;
+  int r = _alloc_journal_load(&free, &entries);
+  if (r < 0) {
+    return r;
+  }
+  for (auto p = free.begin(); p != free.end(); ++p) {
+    dest_allocator->init_add_free(p.get_start(), p.get_len());
+  }
+  *num = free.num_intervals();
+  *bytes = free.size();
+  utime_t duration = ceph_clock_now() - start;
+  dout(1) << __func__ << " replayed " << entries << " journal entries over "
+	  << *num << " base extents in " << duration << " seconds" << dendl;
+  return 0;
+}
+
+void BlueStore::_alloc_journal_reset()
+{
+  alloc_journal_seq = 0;
+  alloc_journal_pending = 0;
+  KeyValueDB::Transaction t = db->get_transaction();
+  if (alloc_journal_enabled) {
+    // the journal restarts from the state captured by _init_alloc
+    t->rmkeys_by_prefix(PREFIX_ALLOC_JOURNAL);
+    _alloc_journal_write_base(t, alloc_journal_base);
+    alloc_journal_base.clear();
+  } else {
+    // never leave a stale base behind: journaling may be re-enabled later
+    auto it = db->get_iterator(PREFIX_ALLOC_JOURNAL, KeyValueDB::ITERATOR_NOCACHE);
+    it->lower_bound(string());
+    if (!it->valid()) {
+      return;
+    }
+    t->rmkeys_by_prefix(PREFIX_ALLOC_JOURNAL);
+  }
+  int r = db->submit_transaction_sync(t);
+  ceph_assert(r == 0);
+}
+
+int BlueStore::_alloc_journal_fold(KeyValueDB::Transaction t,
+				   uint64_t *entries,
+				   uint64_t *chunks)
+{
+  // the journal entries, in seq order, and the base chunks they touch
+  std::vector<std::pair<interval_set<uint64_t>, interval_set<uint64_t>>> sets;
+  std::set<uint64_t> touched;
+  auto note = [&touched](const interval_set<uint64_t>& s) {
+    for (auto q = s.begin(); q != s.end(); ++q) {
+      for (uint64_t c = q.get_start() / ALLOC_JOURNAL_CHUNK_SPAN;
+	   c <= (q.get_end() - 1) / ALLOC_JOURNAL_CHUNK_SPAN;
+	   ++c) {
+	touched.insert(c);
+      }
+    }
+  };
+  auto it = db->get_iterator(PREFIX_ALLOC_JOURNAL, KeyValueDB::ITERATOR_NOCACHE);
+  alloc_journal_set_t free;
+  try {
+    for (it->lower_bound(string(1, ALLOC_JOURNAL_ENTRY_PREFIX));
+	 it->valid();
+	 it->next()) {
+      std::string key = it->key();
+      if (key[0] != ALLOC_JOURNAL_ENTRY_PREFIX) {
+	break;
+      }
+      bufferlist bl = it->value();
+      auto p = bl.cbegin();
+      auto& [allocated, released] = sets.emplace_back();
+      decode(allocated, p);
+      decode(released, p);
+      note(allocated);
+      note(released);
+      t->rmkey(PREFIX_ALLOC_JOURNAL, key);
+    }
+    for (auto c : touched) {
+      bufferlist bl;
+      int r = db->get(PREFIX_ALLOC_JOURNAL, alloc_journal_chunk_key(c), &bl);
+      if (r < 0) {
+	derr << __func__ << " missing base chunk " << c << dendl;
+	return r;
+      }
+      auto p = bl.cbegin();
+      uint32_t count;
+      decode(count, p);
+      while (count--) {
+	uint64_t offset, length;
+	decode(offset, p);
+	decode(length, p);
+	free.union_insert(offset, length);
+      }
+    }
+  } catch (ceph::buffer::error& e) {
+    derr << __func__ << " failed to decode: " << e.what() << dendl;
+    return -EIO;
+  }
+  for (auto& [allocated, released] : sets) {
+    for (auto q = allocated.begin(); q != allocated.end(); ++q) {
+      free.erase(q.get_start(), q.get_len());
+    }
+    for (auto q = released.begin(); q != released.end(); ++q) {
+      free.union_insert(q.get_start(), q.get_len());
+    }
+  }
+  for (auto c : touched) {
+    _alloc_journal_write_chunk(t, c, free);
+  }
+  *entries = sets.size();
+  *chunks = touched.size();
+  return 0;
+}
+
+void BlueStore::_alloc_journal_checkpoint()
+{
+  auto start = mono_clock::now();
+  uint64_t entries = 0, chunks = 0;
+  KeyValueDB::Transaction t = db->get_transaction();
+  int r = _alloc_journal_fold(t, &entries, &chunks);
+  if (r < 0) {
+    derr << __func__ << " failed to fold allocation journal: "
+	 << cpp_strerror(r) << ", disabling it" << dendl;
+    // drop what is left so that recovery falls back to the onode scan;
+    // entries of txcs still in flight can't form a usable journal on their own
+    alloc_journal_enabled = false;
+    t = db->get_transaction();
+    t->rmkeys_by_prefix(PREFIX_ALLOC_JOURNAL);
+    r = db->submit_transaction_sync(t);
+    ceph_assert(r == 0);
+    return;
+  }
+  if (entries == 0) {
+    return;
+  }
+  r = db->submit_transaction_sync(t);
+  ceph_assert(r == 0);
+  alloc_journal_pending -= entries;
+  auto lat = mono_clock::now() - start;
+  logger->tinc(l_bluestore_alloc_journal_checkpoint_lat, lat);
+  dout(5) << __func__ << " folded " << entries << " entries into "
+	  << chunks << " base chunks in " << lat << dendl;
+}
+
 //-----------------------------------------------------------------------------------
 void BlueStore::set_allocation_in_simple_bmap(SimpleBitmap* sbmap, uint64_t offset, uint64_t length)
 {
@@ -20674,6 +21928,7 @@ int BlueStore::read_allocation_from_onodes(SimpleBitmap *sbmap, read_alloc_stats
 
   std::lock_guard l(vstatfs_lock);
   store_statfs_t s;
+  _fold_statfs();
   osd_pools.clear();
   for (auto& p : stats.actual_pool_vstatfs) {
     if (per_pool_stat_collection) {
@@ -117,6 +117,8 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_read_eio,
   l_bluestore_reads_with_retries,
+  l_bluestore_read_shared_bytes,
+  l_bluestore_read_copied_bytes,
   l_bluestore_read_lat,
   //****************************************
 
@@ -165,6 +167,8 @@ enum {
   l_bluestore_decompress_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_pool_skipped,
+  l_bluestore_compress_pool_queued,
   //****************************************
 
   // onode cache stats
@@ -173,8 +177,10 @@ enum {
   l_bluestore_pinned_onodes,
   l_bluestore_onode_hits,
   l_bluestore_onode_misses,
+  l_bluestore_onode_prefetched,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
+  l_bluestore_onode_shard_unloads,
   l_bluestore_extents,
   l_bluestore_blobs,
   l_bluestore_spanning_blobs,
@@ -225,6 +231,8 @@ enum {
   //****************************************
   l_bluestore_allocate_hist,
   l_bluestore_allocator_lat,
+  l_bluestore_alloc_journal_entries,
+  l_bluestore_alloc_journal_checkpoint_lat,
   //****************************************
 
   // slow op counter
@@ -271,6 +279,7 @@ public:
 
   struct BufferSpace;
   struct Collection;
+  struct statfs_accumulator_t;
   struct Onode;
   class Scanner;
   class Estimator;
@@ -1120,6 +1129,9 @@ public:
       KeyValueDB *db,
       int begin_shard,
       int end_shard);
+    /// drop the in-memory extents of clean loaded shards, they get faulted
+    /// in again on demand.  return the number of shards unloaded
+    unsigned unload_clean_shards();
 
     /// ensure a range of the map is marked dirty
     void dirty_range(uint32_t offset, uint32_t length);
@@ -1317,6 +1329,8 @@ public:
     bool cached;              ///< Onode is logically in the cache
                               /// (it can be pinned and hence physically out
                               /// of it at the moment though)
+    std::atomic_bool cache_ref = false; ///< referenced since the last clock
+                                        /// sweep (ClockOnodeCacheShard)
     uint16_t prev_spanning_cnt = 0; /// spanning blobs count
     ExtentMap extent_map;
     BufferSpace bc;             ///< buffer cache
@@ -1519,6 +1533,7 @@ public:
   /// A Generic onode Cache Shard
   struct OnodeCacheShard : public CacheShard {
     std::array<std::pair<ghobject_t, ceph::mono_clock::time_point>, 64> dumped_onodes;
+    bool unload_extent_shards = false; ///< see bluestore_cache_unload_extent_shards
 
   public:
     OnodeCacheShard(CephContext* cct) : CacheShard(cct) {}
@@ -1533,6 +1548,9 @@ public:
 
     virtual void maybe_unpin(Onode* o) = 0;
     virtual void add_stats(uint64_t *onodes, uint64_t *pinned_onodes) = 0;
+    /// shed the extents of an unpinned onode instead of evicting it;
+    /// return false if there was nothing to shed
+    bool _maybe_unload_extents(Onode* o);
     bool empty() {
       return _get_num() == 0;
     }
@@ -1598,6 +1616,7 @@ public:
     friend struct Collection; // for split_cache()
     friend struct Onode; // for put()
     friend struct LruOnodeCacheShard;
+    friend struct ClockOnodeCacheShard;
     void _remove(const ghobject_t& oid);
   public:
     OnodeSpace(OnodeCacheShard *c) : cache(c) {}
@@ -1650,6 +1669,8 @@ public:
 
     ContextQueue *commit_queue;
     std::unique_ptr<Estimator> estimator;
+    /// pending per-pool statfs of our pool, looked up on first write
+    std::atomic<statfs_accumulator_t*> pool_statfs = nullptr;
 
     OnodeCacheShard* get_onode_cache() const {
       return onode_space.cache;
@@ -1808,6 +1829,42 @@ public:
     }
   };
 
+  /// statfs deltas of committed transactions that have not been folded
+  /// into vstatfs/osd_pools yet.  Committing threads add to their own
+  /// (cache line sized) shard without taking any lock; readers drain
+  /// all shards under vstatfs_lock.
+  struct statfs_accumulator_t {
+    static constexpr size_t SHARDS = 16;
+    struct alignas(64) shard_t {
+      std::atomic<int64_t> values[volatile_statfs::STATFS_LAST] = {};
+    };
+    shard_t shards[SHARDS];
+
+    static size_t my_shard() {
+      static std::atomic<size_t> next_shard = 0;
+      thread_local size_t shard = next_shard++ % SHARDS;
+      return shard;
+    }
+    void add(const volatile_statfs& delta) {
+      auto& s = shards[my_shard()];
+      for (size_t i = 0; i < volatile_statfs::STATFS_LAST; ++i) {
+	if (delta.values[i]) {
+	  s.values[i].fetch_add(delta.values[i], std::memory_order_relaxed);
+	}
+      }
+    }
+    /// move everything accumulated so far to *out
+    void drain(volatile_statfs* out) {
+      for (auto& s : shards) {
+	for (size_t i = 0; i < volatile_statfs::STATFS_LAST; ++i) {
+	  if (s.values[i].load(std::memory_order_relaxed)) {
+	    out->values[i] += s.values[i].exchange(0, std::memory_order_relaxed);
+	  }
+	}
+      }
+    }
+  };
+
   struct TransContext final : public AioContext {
     MEMPOOL_CLASS_HELPERS();
 
@@ -1893,6 +1950,7 @@ public:
     interval_set<uint64_t> allocated, released;
     volatile_statfs statfs_delta;	   ///< overall store statistics delta
     uint64_t osd_pool_id = META_POOL_ID;    ///< osd pool id we're operating on
+    statfs_accumulator_t *pool_statfs = nullptr; ///< per-pool stats of osd_pool_id
 
     IOContext ioc;
     bool had_ios = false;  ///< true if we submitted IOs before our kv txn
@@ -2048,6 +2106,15 @@ public:
     uint64_t get_current() {
       return throttle_bytes.get_current();
     }
+    /// true if a transaction of this cost would get through both
+    /// throttles right now without waiting
+    bool can_start_transaction_nowait(int64_t cost) const {
+      auto fits = [cost](const Throttle& t) {
+	auto max = t.get_max();
+	return !max || t.get_current() + cost <= max;
+      };
+      return fits(throttle_bytes) && fits(throttle_deferred_bytes);
+    }
 
   public:
     BlueStoreThrottle(CephContext *cct) :
@@ -2132,6 +2199,18 @@ public:
     }
   };
 
+  /// deferred batches of several sequencers submitted as a single,
+  /// offset ordered set of writes; see bluestore_deferred_coalesce
+  struct DeferredGroup final : public AioContext {
+    std::vector<DeferredBatch*> batches;
+    IOContext ioc;
+
+    DeferredGroup(CephContext *cct)
+      : ioc(cct, this) {}
+
+    void aio_finish(BlueStore *store) override;
+  };
+
   class OpSequencer : public RefCountedObject {
   public:
     ceph::mutex qlock = ceph::make_mutex("BlueStore::OpSequencer::qlock");
@@ -2270,23 +2349,71 @@ public:
       boost::intrusive::list_member_hook<>,
       &OpSequencer::deferred_osr_queue_item> > deferred_osr_queue_t;
 
+  struct KVSyncLane;
   struct KVSyncThread : public Thread {
     BlueStore *store;
-    explicit KVSyncThread(BlueStore *s) : store(s) {}
+    KVSyncLane *lane;
+    KVSyncThread(BlueStore *s, KVSyncLane *l) : store(s), lane(l) {}
     void *entry() override {
-      store->_kv_sync_thread();
+      store->_kv_sync_thread(*lane);
       return NULL;
     }
   };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
-    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    KVSyncLane *lane;
+    KVFinalizeThread(BlueStore *s, KVSyncLane *l) : store(s), lane(l) {}
     void *entry() override {
-      store->_kv_finalize_thread();
+      store->_kv_finalize_thread(*lane);
       return NULL;
     }
   };
 
+  /// one kv commit pipeline: a sync thread batching and committing kv
+  /// transactions, and a finalize thread completing them.  every
+  /// OpSequencer is pinned to a single lane (see _get_kv_lane), so the
+  /// per-sequencer ordering is preserved while different sequencers
+  /// commit in parallel.
+  struct KVSyncLane {
+    const uint32_t id;
+
+    KVSyncThread kv_sync_thread;
+    ceph::mutex kv_lock = ceph::make_mutex("BlueStore::KVSyncLane::kv_lock");
+    ceph::condition_variable kv_cond;
+    bool kv_sync_started = false;
+    bool kv_stop = false;
+    std::deque<TransContext*> kv_queue;             ///< ready, already submitted
+    std::deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
+    std::deque<TransContext*> kv_committing;        ///< currently syncing
+    std::deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
+    bool kv_sync_in_progress = false;
+    uint64_t kv_ios = 0;
+    uint64_t kv_throttle_costs = 0;
+    uint64_t kv_throttle_txcs = 0;
+
+    KVFinalizeThread kv_finalize_thread;
+    ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::KVSyncLane::kv_finalize_lock");
+    ceph::condition_variable kv_finalize_cond;
+    bool kv_finalize_started = false;
+    bool kv_finalize_stop = false;
+    std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
+    std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
+    bool kv_finalize_in_progress = false;
+
+    KVSyncLane(BlueStore *store, uint32_t i)
+      : id(i),
+	kv_sync_thread(store, this),
+	kv_finalize_thread(store, this) {}
+
+    /// wake up the sync thread; caller must hold kv_lock
+    void wake_sync() {
+      if (!kv_sync_in_progress) {
+	kv_sync_in_progress = true;
+	kv_cond.notify_one();
+      }
+    }
+  };
+
   struct BigDeferredWriteContext {
     uint64_t off = 0;     // original logical offset
     uint32_t b_off = 0;   // blob relative offset
@@ -2336,6 +2463,14 @@ private:
   bool db_was_opened_read_only = true;
   bool need_to_destage_allocation_file = false;
 
+  // NCB allocation journal (see bluestore_allocation_journal)
+  typedef interval_set<uint64_t, std::map, false> alloc_journal_set_t;
+  std::atomic<bool> alloc_journal_enabled = {false};
+  std::atomic<uint64_t> alloc_journal_seq = {0};
+  std::atomic<uint64_t> alloc_journal_pending = {0};
+  std::atomic<bool> alloc_journal_checkpointing = {false};
+  alloc_journal_set_t alloc_journal_base; ///< free space captured at _init_alloc
+
   ///< rwlock to protect coll_map/new_coll_map
   ceph::shared_mutex coll_lock = ceph::make_shared_mutex("BlueStore::coll_lock");
   mempool::bluestore_cache_other::unordered_map<coll_t, CollectionRef> coll_map;
@@ -2362,32 +2497,21 @@ private:
   deferred_osr_queue_t deferred_queue; ///< osr's with deferred io pending
   std::atomic_int deferred_queue_size = {0};         ///< num txc's queued across all osrs
   std::atomic_int deferred_aggressive = {0}; ///< aggressive wakeup of kv thread
+  std::atomic_uint deferred_elevator_up = {1}; ///< next coalesced submit direction (1 = up)
   Finisher  finisher;
+  Finisher  alloc_journal_finisher; ///< runs _alloc_journal_checkpoint()
   utime_t  deferred_last_submitted = utime_t();
 
-  KVSyncThread kv_sync_thread;
-  ceph::mutex kv_lock = ceph::make_mutex("BlueStore::kv_lock");
-  ceph::condition_variable kv_cond;
   bool _kv_only = false;
-  bool kv_sync_started = false;
-  bool kv_stop = false;
-  bool kv_finalize_started = false;
-  bool kv_finalize_stop = false;
-  std::deque<TransContext*> kv_queue;             ///< ready, already submitted
-  std::deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
-  std::deque<TransContext*> kv_committing;        ///< currently syncing
-  std::deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
-  bool kv_sync_in_progress = false;
-
-  KVFinalizeThread kv_finalize_thread;
-  ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
-  ceph::condition_variable kv_finalize_cond;
-  std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
-  std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
-  bool kv_finalize_in_progress = false;
+  std::vector<std::unique_ptr<KVSyncLane>> kv_lanes; ///< see bluestore_kv_sync_lanes
+  /// serializes {nid,blobid}_max updates issued by different lanes
+  ceph::mutex kv_prealloc_lock = ceph::make_mutex("BlueStore::kv_prealloc_lock");
 
   PerfCounters *logger = nullptr;
 
+  /// protect removed_collections (filled by all finalize lanes)
+  ceph::mutex removed_collections_lock =
+    ceph::make_mutex("BlueStore::removed_collections_lock");
   std::list<CollectionRef> removed_collections;
 
   ceph::shared_mutex debug_read_error_lock =
@@ -2438,15 +2562,43 @@ private:
   std::atomic<uint64_t> comp_min_blob_size = {0};
   std::atomic<uint64_t> comp_max_blob_size = {0};
 
+  /// one blob to be compressed, possibly on a compression pool thread
+  struct CompressJob {
+    CompressorRef compressor;
+    ceph::buffer::list *in;
+    ceph::buffer::list out;
+    std::optional<int32_t> compressor_message;
+    int r = 0;               ///< -EBUSY if skipped, pool was saturated
+    ceph::timespan lat;      ///< time spent compressing
+
+    CompressJob(CompressorRef c, ceph::buffer::list *i)
+      : compressor(c), in(i) {}
+  };
+  struct CompressBatch;
+  struct CompressThread : public Thread {
+    BlueStore *store;
+    explicit CompressThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_compress_thread();
+      return NULL;
+    }
+  };
+  /// bounded pool compressing the blobs of large writes in parallel,
+  /// see bluestore_compression_threads
+  ceph::mutex compress_lock = ceph::make_mutex("BlueStore::compress_lock");
+  ceph::condition_variable compress_cond;      ///< wakes pool threads
+  ceph::condition_variable compress_done_cond; ///< wakes submitters
+  std::deque<CompressBatch*> compress_queue;
+  uint64_t compress_queued = 0;  ///< admitted jobs not completed yet
+  uint64_t compress_queue_max = 0;
+  bool compress_stop = false;
+  std::vector<std::unique_ptr<CompressThread>> compress_threads;
+
   std::atomic<uint64_t> max_blob_size = {0};  ///< maximum blob size
   std::atomic<uint32_t> segment_size = {0}; ///< snapshot of conf value "bluestore_onode_segment_size"
                                             /// When 0 onode_bluestore_t v2 is in force, otherwise v3 is used.
                                             /// Ability to disable is important for efficient testing.
 
-  uint64_t kv_ios = 0;
-  uint64_t kv_throttle_costs = 0;
-  uint64_t kv_throttle_txcs = 0;
-
   // cache trim control
   uint64_t cache_size = 0;       ///< total cache size
   double cache_meta_ratio = 0;   ///< cache ratio dedicated to metadata
@@ -2486,6 +2638,12 @@ private:
   volatile_statfs vstatfs;
   osd_pools_map osd_pools; // protected by vstatfs_lock as well
 
+  // not yet folded into vstatfs and osd_pools, see _fold_statfs()
+  statfs_accumulator_t vstatfs_pending;
+  // protected by vstatfs_lock; entries are never removed while mounted
+  // so that transactions can keep pointers to them
+  std::map<uint64_t, std::unique_ptr<statfs_accumulator_t>> osd_pools_pending;
+
   bool per_pool_stat_collection = true;
 
   class SocketHook;
@@ -2860,6 +3018,8 @@ private:
 			    std::list<Context*> *on_commits,
 			    TrackedOpRef osd_op=TrackedOpRef());
   void _txc_update_store_statfs(TransContext *txc);
+  statfs_accumulator_t* _get_pool_statfs_pending(uint64_t pool_id);
+  void _fold_statfs();
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
@@ -2885,15 +3045,32 @@ private:
 
   void _kv_start();
   void _kv_stop();
-  void _kv_sync_thread();
-  void _kv_finalize_thread();
+
+  void _compress_start();
+  void _compress_stop();
+  void _compress_thread();
+  void _compress_run(CompressJob& job);
+  /// compress all jobs, spreading them over the compression pool.  when
+  /// may_skip is set, jobs that do not fit into the pool queue are not
+  /// compressed at all and get r = -EBUSY.
+  void _compress_jobs(std::vector<CompressJob>& jobs, bool may_skip);
+  KVSyncLane& _get_kv_lane(const OpSequencer *osr) {
+    ceph_assert(!kv_lanes.empty());
+    return *kv_lanes[osr->get_sequencer_id() % kv_lanes.size()];
+  }
+  void _kv_wake_all_lanes();
+  void _kv_sync_thread(KVSyncLane& lane);
+  void _kv_finalize_thread(KVSyncLane& lane);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, uint64_t len);
   void _deferred_queue(TransContext *txc);
 public:
   void deferred_try_submit();
 private:
+  DeferredBatch *_deferred_detach_unlock(OpSequencer *osr);
   void _deferred_submit_unlock(OpSequencer *osr);
+  void _deferred_submit_batch(DeferredBatch *b);
+  void _deferred_submit_coalesced(std::vector<DeferredBatch*>& batches);
   void _deferred_aio_finish(OpSequencer *osr);
   int _deferred_replay();
   bool _eliminate_outdated_deferred(bluestore_deferred_transaction_t* deferred_txn,
@@ -3042,6 +3219,11 @@ public:
   uint64_t get_min_alloc_size() const override {
     return min_alloc_size;
   }
+  bool can_queue_write_nowait(uint64_t bytes) override {
+    // the kv commit plus one data io, see _txc_calc_cost()
+    return throttle.can_start_transaction_nowait(
+      bytes + 2 * throttle_cost_per_io);
+  }
 
   int get_devices(std::set<std::string> *ls) override;
 
@@ -3178,6 +3360,8 @@ public:
   void collect_metadata(std::map<std::string,std::string> *pm) override;
 
   bool exists(CollectionHandle &c, const ghobject_t& oid) override;
+  void prefetch(CollectionHandle &c,
+		const std::vector<ghobject_t>& oids) override;
   int set_collection_opts(
     CollectionHandle& c,
     const pool_opts_t& opts) override;
@@ -3473,6 +3657,8 @@ public:
 			   coll_t cid2, ghobject_t oid2,
 			   uint64_t offset);
   void inject_zombie_spanning_blob(coll_t cid, ghobject_t oid, int16_t blob_id);
+  // adds a copy of the first extent shard key of the onode at a bogus offset
+  void inject_stray_shard_key(coll_t cid, ghobject_t oid);
   // resets global per_pool_omap in DB
   void inject_legacy_omap();
   // resets per_pool_omap | pgmeta_omap for onode
@@ -3959,6 +4145,8 @@ public:
     per_pool_statfs& expected_pool_statfs;
     per_pool_fsck_stats_t& per_pool_fsck_stats;
     BlueStoreRepairer* repairer;
+    // protects used_blocks in multithreading mode only
+    ceph::mutex* used_blocks_lock = nullptr;
 
     FSCK_ObjectCtx(int64_t& e,
                    int64_t& w,
@@ -4008,6 +4196,17 @@ public:
     mempool::bluestore_fsck::list<std::string>* expecting_shards,
     std::map<BlobRef, bluestore_blob_t::unused_t>* referenced,
     BlueStore::FSCK_ObjectCtx& ctx);
+  void fsck_check_objects_full(
+    FSCKDepth depth,
+    int64_t pool_id,
+    CollectionRef c,
+    const ghobject_t& oid,
+    const std::string& key,
+    const ceph::buffer::list& value,
+    const mempool::bluestore_fsck::list<std::string>& shard_keys,
+    uint64_t_btree_t& used_nids,
+    ceph::mutex* lock,
+    BlueStore::FSCK_ObjectCtx& ctx);
 #ifdef CEPH_BLUESTORE_TOOL_RESTORE_ALLOCATION
   int  push_allocation_to_rocksdb();
   int  read_allocation_from_drive_for_bluestore_tool();
@@ -4104,6 +4303,19 @@ private:
   int  __restore_allocator(Allocator* allocator, uint64_t *num, uint64_t *bytes);
   int  restore_allocator(Allocator* allocator, uint64_t *num, uint64_t *bytes);
   int  read_allocation_from_drive_on_startup();
+  int  _alloc_journal_load(alloc_journal_set_t *free, uint64_t *entries);
+  void _alloc_journal_write_chunk(KeyValueDB::Transaction t,
+				  uint64_t chunk,
+				  const alloc_journal_set_t& free);
+  void _alloc_journal_write_base(KeyValueDB::Transaction t,
+				 const alloc_journal_set_t& free);
+  int  _alloc_journal_fold(KeyValueDB::Transaction t,
+			   uint64_t *entries, uint64_t *chunks);
+  int  _restore_allocator_from_journal(Allocator* dest_allocator,
+				       uint64_t *num, uint64_t *bytes);
+  void _alloc_journal_reset();
+  void _alloc_journal_checkpoint();
+  void _txc_journal_alloc(TransContext *txc, KeyValueDB::Transaction t);
   int  reconstruct_allocations(SimpleBitmap *smbmp, read_alloc_stats_t &stats);
   int  read_allocation_from_onodes(SimpleBitmap *smbmp, read_alloc_stats_t& stats);
   int  commit_freelist_type();
@@ -4121,8 +4333,20 @@ private:
     OnodeRef& o,
     const BlueStore::FSCK_ObjectCtx& ctx);
 
+  void _fsck_check_object_full(FSCKDepth depth,
+    CollectionRef& c,
+    const ghobject_t& oid,
+    OnodeRef& o,
+    const std::map<BlobRef, bluestore_blob_t::unused_t>& referenced,
+    uint64_t_btree_t& used_nids,
+    ceph::mutex* lock,
+    const BlueStore::FSCK_ObjectCtx& ctx);
+
   void _fsck_check_objects(FSCKDepth depth,
     FSCK_ObjectCtx& ctx);
+  void _fsck_check_objects_parallel(FSCKDepth depth,
+    size_t thread_count,
+    FSCK_ObjectCtx& ctx);
 
 public:
   static int create_bdev_labels(CephContext *cct,
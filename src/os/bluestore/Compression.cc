@@ -195,28 +195,37 @@ int32_t Estimator::split_and_compress(
   blob_sizes.back() = size - blob_size * (blobs - 1);
   int32_t disk_needed = 0;
   uint32_t bl_src_off = 0;
+  size_t first = bd.size();
   for (auto& i: blob_sizes) {
     bd.emplace_back();
     bd.back().real_length = i;
     bd.back().compressed_length = 0;
     bd.back().object_data.substr_of(data_bl, bl_src_off, i);
     bl_src_off += i;
+  }
+  std::vector<BlueStore::CompressJob> jobs;
+  jobs.reserve(blobs);
+  for (size_t i = first; i < bd.size(); i++) {
+    jobs.emplace_back(wctx->compressor, &bd[i].object_data);
+  }
+  // the split was sized assuming compression, so do not let the pool
+  // skip any of the blobs
+  bluestore->_compress_jobs(jobs, false);
+  for (size_t i = first; i < bd.size(); i++) {
+    auto& job = jobs[i - first];
     // FIXME: memory alignment here is bad
-    bufferlist t;
-    std::optional<int32_t> compressor_message;
-    int r = wctx->compressor->compress(bd.back().object_data, t, compressor_message);
-    ceph_assert(r == 0);
+    ceph_assert(job.r == 0);
     bluestore_compression_header_t chdr;
     chdr.type = wctx->compressor->get_type();
-    chdr.length = t.length();
-    chdr.compressor_message = compressor_message;
-    encode(chdr, bd.back().disk_data);
-    bd.back().disk_data.claim_append(t);
-    uint32_t len = bd.back().disk_data.length();
-    bd.back().compressed_length = len;
+    chdr.length = job.out.length();
+    chdr.compressor_message = job.compressor_message;
+    encode(chdr, bd[i].disk_data);
+    bd[i].disk_data.claim_append(job.out);
+    uint32_t len = bd[i].disk_data.length();
+    bd[i].compressed_length = len;
     uint32_t rem = p2nphase(len, au_size);
     if (rem > 0) {
-      bd.back().disk_data.append_zero(rem);
+      bd[i].disk_data.append_zero(rem);
     }
     actual_compressed += len;
     actual_compressed_plus_pad += len + rem;
@@ -2427,6 +2427,10 @@ OSD::OSD(CephContext *cct_,
   osd_compat(get_osd_compat_set()),
   osd_op_tp(cct, "OSD::osd_op_tp", "tp_osd_tp",
 	    get_num_op_threads()),
+  map_mapping_tp(cct, "OSD::map_mapping_tp", "tp_osd_map",
+		 cct->_conf.get_val<uint64_t>("osd_map_mapping_threads")),
+  map_mapper(cct, &map_mapping_tp),
+  pg_mappings(&map_mapper),
   heartbeat_stop(false),
   heartbeat_need_update(true),
   hb_front_client_messenger(hb_client_front),
@@ -2524,6 +2528,8 @@ OSD::OSD(CephContext *cct_,
 
   // initialize shards
   num_shards = get_num_op_shards();
+  op_inline_max_bytes =
+    cct->_conf.get_val<Option::size_t>("osd_op_inline_max_bytes");
   for (uint32_t i = 0; i < num_shards; i++) {
     OSDShard *one_shard = new OSDShard(
       i,
@@ -3983,6 +3989,7 @@ int OSD::init()
   }
 
   osd_op_tp.start();
+  map_mapping_tp.start();
 
   // start the heartbeat
   heartbeat_thread.create("osd_srv_heartbt");
@@ -4641,6 +4648,9 @@ int OSD::shutdown()
       tick_timer_without_osd_lock.shutdown();
     }
 
+    pg_mappings.cancel(std::numeric_limits<epoch_t>::max());
+    map_mapping_tp.stop();
+
     osd_lock.unlock();
     utime_t  start_time_osd_drain = ceph_clock_now();
 
@@ -4716,6 +4726,9 @@ int OSD::shutdown()
   hb_front_client_messenger->mark_down_all();
   hb_back_client_messenger->mark_down_all();
 
+  pg_mappings.cancel(std::numeric_limits<epoch_t>::max());
+  map_mapping_tp.stop();
+
   osd_op_tp.drain();
   osd_op_tp.stop();
   dout(10) << "op sharded tp stopped" << dendl;
@@ -7737,11 +7750,12 @@ void OSD::ms_fast_dispatch(Message *m)
   if (!legacy &&
       (m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) ||
        m->get_type() != CEPH_MSG_OSD_OP)) {
+    epoch_t epoch = static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch();
+    if (op_inline_max_bytes && try_run_op_inline(spg, op, epoch)) {
+      return;
+    }
     // queue it directly
-    enqueue_op(
-      spg,
-      std::move(op),
-      static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch());
+    enqueue_op(spg, std::move(op), epoch);
   } else {
     // legacy client, and this is an MOSDOp (the *only* fast dispatch
     // message that didn't have an explicit spg_t); we need to map
@@ -8396,6 +8410,8 @@ void OSD::handle_osd_map(MOSDMap *m)
   // even if this map isn't from a mon, we may have satisfied our subscription
   monc->sub_got("osdmap", last);
 
+  queue_pg_mappings(added_maps);
+
   if (!m->maps.empty() && requested_full_first) {
     dout(10) << __func__ << " still missing full maps " << requested_full_first
 	     << ".." << requested_full_last << dendl;
@@ -8941,6 +8957,45 @@ bool OSD::add_merge_waiter(OSDMapRef nextmap, spg_t target, PGRef src,
   return p.size() == need;
 }
 
+void OSD::queue_pg_mappings(const map<epoch_t,OSDMapRef>& added_maps)
+{
+  ceph_assert(ceph_mutex_is_locked(osd_lock));
+  if (map_mapping_tp.get_num_threads() == 0 || is_stopping()) {
+    return;
+  }
+  // epochs every pg has already consumed are of no further use
+  epoch_t osd_min = 0;
+  for (auto shard : shards) {
+    epoch_t min = shard->get_min_pg_epoch();
+    if (osd_min == 0 || min < osd_min) {
+      osd_min = min;
+    }
+  }
+  pg_mappings.cancel(osd_min);
+  if (osd_min == 0) {
+    return;
+  }
+
+  vector<spg_t> spgids;
+  _get_pgids(&spgids);
+  set<pg_t> pgids;
+  for (auto& spgid : spgids) {
+    pgids.insert(spgid.pgid);
+  }
+  if (pgids.empty()) {
+    return;
+  }
+  unsigned pgs_per_item =
+    std::max<unsigned>(1, pgids.size() / map_mapping_tp.get_num_threads());
+  for (auto& [e, m] : added_maps) {
+    if (e > osd_min) {
+      pg_mappings.queue(e, m, pgids, pgs_per_item);
+    }
+  }
+  dout(20) << __func__ << " " << pgids.size() << " pgs, "
+	   << pg_mappings.size() << " epochs pending or mapped" << dendl;
+}
+
 bool OSD::advance_pg(
   epoch_t osd_epoch,
   PG *pg,
@@ -9088,10 +9143,15 @@ bool OSD::advance_pg(
 
     vector<int> newup, newacting;
     int up_primary, acting_primary;
-    nextmap->pg_to_up_acting_osds(
-      pg->pg_id.pgid,
-      &newup, &up_primary,
-      &newacting, &acting_primary);
+    if (!pg_mappings.get(
+	  next_epoch, pg->pg_id.pgid,
+	  &newup, &up_primary,
+	  &newacting, &acting_primary)) {
+      nextmap->pg_to_up_acting_osds(
+	pg->pg_id.pgid,
+	&newup, &up_primary,
+	&newacting, &acting_primary);
+    }
     pg->handle_advance_map(
       nextmap, lastmap, newup, up_primary,
       newacting, acting_primary, rctx);
@@ -9711,6 +9771,19 @@ unsigned OSDService::get_target_pg_log_entries() const
   }
 }
 
+unsigned OSDService::get_target_object_contexts() const
+{
+  auto num_pgs = osd->get_num_pgs();
+  auto target = cct->_conf->osd_target_object_contexts_per_osd;
+  unsigned min = std::max<int64_t>(
+    cct->_conf->osd_pg_object_context_cache_count, 1);
+  if (num_pgs > 0 && target > 0) {
+    return std::max<unsigned>(target / num_pgs, min);
+  } else {
+    return min;
+  }
+}
+
 void OSD::do_recovery(
   PG *pg, epoch_t queued, uint64_t reserved_pushes, int priority,
   ThreadPool::TPHandle &handle)
@@ -9903,6 +9976,87 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch)
   }
 }
 
+/*
+ * Run a small client write to completion on the dispatching (messenger)
+ * thread instead of handing it to a shard worker.  This is only done
+ * when nothing could be ordered before it: the shard's scheduler is
+ * idle, nothing is queued, waiting or running for the pg, and the pg
+ * lock is free.  The messenger thread is shared with other connections,
+ * so the op must not block either: the pg only accepts it if it will not
+ * read from the store or wait for store throttles, see
+ * PG::can_run_op_inline().
+ */
+bool OSD::try_run_op_inline(spg_t pgid, OpRequestRef& op, epoch_t epoch)
+{
+  const Message *m = op->get_req();
+  if (m->get_type() != CEPH_MSG_OSD_OP) {
+    return false;
+  }
+  const MOSDOp *mop = static_cast<const MOSDOp*>(m);
+  if (!(mop->get_flags() & CEPH_OSD_FLAG_WRITE) ||
+      (mop->get_flags() & CEPH_OSD_FLAG_READ) ||
+      mop->get_data_len() > op_inline_max_bytes) {
+    return false;
+  }
+
+  OSDShard *sdata = shards[pgid.hash_to_shard(shards.size())];
+  PGRef pg;
+  {
+    std::lock_guard l{sdata->shard_lock};
+    if (sdata->inline_running ||
+	!sdata->scheduler->empty() ||
+	epoch > sdata->shard_osdmap->get_epoch()) {
+      return false;
+    }
+    auto p = sdata->pg_slots.find(pgid);
+    if (p == sdata->pg_slots.end()) {
+      return false;
+    }
+    OSDShardPGSlot *slot = p->second.get();
+    if (!slot->pg ||
+	slot->num_running ||
+	!slot->to_process.empty() ||
+	!slot->waiting.empty() ||
+	!slot->waiting_peering.empty() ||
+	!slot->waiting_for_split.empty()) {
+      return false;
+    }
+    // we hold the shard lock, so we must not block on the pg lock
+    if (!slot->pg->try_lock()) {
+      return false;
+    }
+    pg = slot->pg;
+    if (!pg->is_active() || !pg->is_primary() ||
+	!pg->get_pgpool().info.is_replicated() ||
+	!pg->can_run_op_inline(op)) {
+      pg->unlock();
+      return false;
+    }
+    sdata->inline_running = true;
+    sdata->inline_hb->thread_id = pthread_self();
+  }
+
+  dout(15) << __func__ << " " << *m << dendl;
+  op->osd_trace.event("run inline");
+  op->mark_queued_for_pg();
+  logger->inc(l_osd_op_inline);
+  logger->tinc(l_osd_op_before_queue_op_lat,
+	       ceph_clock_now() - m->get_recv_stamp());
+  {
+    ThreadPool::TPHandle tp_handle(cct, sdata->inline_hb,
+				   op_shardedwq.timeout_interval.load(),
+				   op_shardedwq.suicide_interval.load());
+    tp_handle.reset_tp_timeout();
+    dequeue_op(pg, std::move(op), tp_handle);
+    pg->unlock();
+    tp_handle.suspend_tp_timeout();
+  }
+
+  std::lock_guard l{sdata->shard_lock};
+  sdata->inline_running = false;
+  return true;
+}
+
 void OSD::enqueue_peering_evt(spg_t pgid, PGPeeringEventRef evt)
 {
   dout(15) << __func__ << " " << pgid << " " << evt->get_desc() << dendl;
@@ -11057,6 +11211,13 @@ OSDShard::OSDShard(
       "ec_extent_cache_size"))
 {
   dout(0) << "using op scheduler " << *scheduler << dendl;
+  inline_hb = cct->get_heartbeat_map()->add_worker(
+    shard_name + "::inline", pthread_self());
+}
+
+OSDShard::~OSDShard()
+{
+  cct->get_heartbeat_map()->remove_worker(inline_hb);
 }
 
 
@@ -53,6 +53,7 @@
 #include "messages/MOSDOp.h"
 #include "common/EventTrace.h"
 #include "osd/osd_perf_counters.h"
+#include "osd/OSDMapMapping.h"
 #include "common/Finisher.h"
 #include "scrubber/osd_scrub.h"
 
@@ -644,6 +645,7 @@ public:
   }
 
   unsigned get_target_pg_log_entries() const;
+  unsigned get_target_object_contexts() const;
 
   // delayed pg activation
   void queue_for_recovery(
@@ -1021,6 +1023,11 @@ struct OSDShard {
 
   ContextQueue context_queue;
 
+  /// a client op is being run on its dispatching thread, see
+  /// OSD::try_run_op_inline().  one at a time, so that inline_hb is ours.
+  bool inline_running = false;
+  ceph::heartbeat_handle_d *inline_hb = nullptr;
+
   //This is an extent cache for the erasure coding. Specifically, this acts as
   //a least-recently-used cache invalidator, allowing for cache shards to last
   //longer than the most recent IO in each object.
@@ -1063,6 +1070,7 @@ struct OSDShard {
     OSD *osd,
     op_queue_type_t osd_op_queue,
     unsigned osd_op_queue_cut_off);
+  ~OSDShard();
 };
 
 struct OSDBenchTest {
@@ -1456,6 +1464,15 @@ private:
 
   ShardedThreadPool osd_op_tp;
 
+  // -- pg mapping precalculation --
+  /// up/acting sets of the local pgs in new maps, worked out by
+  /// map_mapping_tp ahead of advance_pg()
+  ThreadPool map_mapping_tp;
+  ParallelPGMapper map_mapper;
+  PGMappingPrecalc pg_mappings;
+
+  void queue_pg_mappings(const std::map<epoch_t,OSDMapRef>& added_maps);
+
   void get_latest_osdmap();
 
   // -- sessions --
@@ -1815,6 +1832,7 @@ protected:
 
 
   void enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch);
+  bool try_run_op_inline(spg_t pgid, OpRequestRef& op, epoch_t epoch);
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
@@ -1929,6 +1947,7 @@ public:
   // -- shards --
   std::vector<OSDShard*> shards;
   uint32_t num_shards = 0;
+  uint64_t op_inline_max_bytes = 0;  ///< osd_op_inline_max_bytes
 
   void inc_num_pgs() {
     ++num_pgs;
@@ -205,3 +205,82 @@ void ParallelPGMapper::queue(
   }
   ceph_assert(any);
 }
+
+// ---------------------------
+
+PGMappingPrecalc::Job::Job(
+  std::shared_ptr<const OSDMap> m,
+  const std::set<pg_t>& pgids)
+  : ParallelPGMapper::Job(m.get()), map(std::move(m))
+{
+  for (auto& pgid : pgids) {
+    mappings.emplace_hint(mappings.end(), pgid, mapping_t());
+  }
+}
+
+void PGMappingPrecalc::Job::process(const std::vector<pg_t>& pgs)
+{
+  for (auto& pgid : pgs) {
+    auto& m = mappings.find(pgid)->second;
+    osdmap->pg_to_up_acting_osds(
+      pgid, &m.up, &m.up_primary, &m.acting, &m.acting_primary);
+  }
+}
+
+void PGMappingPrecalc::queue(
+  epoch_t e,
+  std::shared_ptr<const OSDMap> map,
+  const std::set<pg_t>& pgids,
+  unsigned pgs_per_item)
+{
+  if (pgids.empty()) {
+    return;
+  }
+  std::lock_guard l(lock);
+  if (jobs.count(e)) {
+    return;
+  }
+  auto job = std::make_unique<Job>(std::move(map), pgids);
+  mapper->queue(job.get(), pgs_per_item,
+		std::vector<pg_t>(pgids.begin(), pgids.end()));
+  jobs.emplace(e, std::move(job));
+}
+
+void PGMappingPrecalc::cancel(epoch_t upto)
+{
+  std::map<epoch_t, std::unique_ptr<Job>> done;
+  {
+    std::lock_guard l(lock);
+    auto p = jobs.upper_bound(upto);
+    done.insert(std::make_move_iterator(jobs.begin()),
+		std::make_move_iterator(p));
+    jobs.erase(jobs.begin(), p);
+  }
+  for (auto& [e, job] : done) {
+    if (!job->is_done()) {
+      job->abort();
+    }
+  }
+}
+
+bool PGMappingPrecalc::get(
+  epoch_t e, pg_t pgid,
+  std::vector<int> *up, int *up_primary,
+  std::vector<int> *acting, int *acting_primary)
+{
+  std::lock_guard l(lock);
+  auto p = jobs.find(e);
+  if (p == jobs.end() || !p->second->is_done()) {
+    return false;
+  }
+  auto q = p->second->mappings.find(pgid);
+  if (q == p->second->mappings.end()) {
+    // created or split off after the job was queued
+    return false;
+  }
+  *up = q->second.up;
+  *up_primary = q->second.up_primary;
+  *acting = q->second.acting;
+  *acting_primary = q->second.acting_primary;
+  return true;
+}
@@ -6,7 +6,10 @@
 #define CEPH_OSDMAPMAPPING_H
 
 #include <vector>
+#include <limits>
 #include <map>
+#include <memory>
+#include <set>
 
 #include "osd/osd_types.h"
 #include "common/WorkQueue.h"
@@ -171,6 +174,56 @@ public:
 };
 
 
+/// up/acting sets of a fixed set of PGs in upcoming OSDMaps, worked out
+/// ahead of time, one ParallelPGMapper job per epoch
+class PGMappingPrecalc {
+  struct Job : public ParallelPGMapper::Job {
+    struct mapping_t {
+      std::vector<int> up, acting;
+      int up_primary = -1, acting_primary = -1;
+    };
+    std::shared_ptr<const OSDMap> map;  ///< pinned until the job completes
+    std::map<pg_t, mapping_t> mappings; ///< keys are fixed at construction
+
+    Job(std::shared_ptr<const OSDMap> m, const std::set<pg_t>& pgids);
+    void process(const std::vector<pg_t>& pgs) override;
+    void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {}
+    void complete() override {
+      map.reset();
+    }
+  };
+
+  ParallelPGMapper *mapper;
+  ceph::mutex lock = ceph::make_mutex("PGMappingPrecalc::lock");
+  std::map<epoch_t, std::unique_ptr<Job>> jobs;
+
+public:
+  explicit PGMappingPrecalc(ParallelPGMapper *m) : mapper(m) {}
+  ~PGMappingPrecalc() {
+    cancel(std::numeric_limits<epoch_t>::max());
+  }
+
+  /// start mapping pgids in map e, unless that epoch is already queued
+  void queue(
+    epoch_t e,
+    std::shared_ptr<const OSDMap> map,
+    const std::set<pg_t>& pgids,
+    unsigned pgs_per_item);
+  /// abort and drop the mappings of epochs up to and including upto
+  void cancel(epoch_t upto);
+  /// false if the mapping of pgid in epoch e is not (yet) known
+  bool get(
+    epoch_t e, pg_t pgid,
+    std::vector<int> *up, int *up_primary,
+    std::vector<int> *acting, int *acting_primary);
+  /// epochs pending or mapped
+  size_t size() {
+    std::lock_guard l(lock);
+    return jobs.size();
+  }
+};
+
+
 /// a precalculated mapping of every PG for a given OSDMap
 class OSDMapMapping {
 public:
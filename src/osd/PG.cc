@@ -251,6 +251,20 @@ void PG::lock(bool no_lockdep) const
   dout(30) << "lock" << dendl;
 }
 
+bool PG::try_lock() const
+{
+  if (!_lock.try_lock()) {
+    return false;
+  }
+#ifndef CEPH_DEBUG_MUTEX
+  locked_by = std::this_thread::get_id();
+#endif
+  ceph_assert(!recovery_state.debug_has_dirty_state());
+
+  dout(30) << "try_lock" << dendl;
+  return true;
+}
+
 bool PG::is_locked() const
 {
   return ceph_mutex_is_locked(_lock);
@@ -222,6 +222,7 @@ public:
     uint64_t events, utime_t event_dur) override;
 
   void lock(bool no_lockdep = false) const;
+  bool try_lock() const;
   void unlock() const;
   bool is_locked() const;
 
@@ -725,6 +726,8 @@ public:
     OpRequestRef& op,
     ThreadPool::TPHandle &handle
   ) = 0;
+  /// true if op can be run without blocking on the object store
+  virtual bool can_run_op_inline(OpRequestRef& op) = 0;
   virtual void clear_cache() = 0;
   virtual int get_cache_obj_count() = 0;
 
@@ -632,6 +632,17 @@ int PGBackend::objects_get_attr(
   return r;
 }
 
+void PGBackend::objects_prefetch(const vector<hobject_t> &ls)
+{
+  vector<ghobject_t> oids;
+  oids.reserve(ls.size());
+  for (auto& hoid : ls) {
+    oids.emplace_back(hoid, ghobject_t::NO_GEN,
+		      get_parent()->whoami_shard().shard);
+  }
+  store->prefetch(ch, oids);
+}
+
 int PGBackend::objects_get_attrs(
   const hobject_t &hoid,
   map<string, bufferlist, less<>> *out)
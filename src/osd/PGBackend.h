@@ -590,6 +590,9 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      const std::string &attr,
      ceph::buffer::list *out);
 
+   /// hint the store that ls is about to be read, in order
+   void objects_prefetch(const std::vector<hobject_t> &ls);
+
    virtual int objects_get_attrs(
      const hobject_t &hoid,
      std::map<std::string, ceph::buffer::list, std::less<>> *out);
@@ -890,6 +890,17 @@ void PGLog::_write_log_and_missing(
 		     << " write_from_dups=" << write_from_dups
 		     << " trimmed_dups.size()=" << trimmed_dups.size() << dendl;
   set<string> to_remove;
+  // trimmed entries and dups are the oldest ones, so each set is a
+  // contiguous run of keys
+  const bool range_delete =
+    dpp->get_cct()->_conf->osd_pg_log_trim_range_delete;
+  if (range_delete && trimmed_dups.size() > 1) {
+    // a key followed by a NUL is the smallest key after it
+    t.omap_rmkeyrange(
+      coll, log_oid,
+      *trimmed_dups.begin(), *trimmed_dups.rbegin() + '\0');
+    trimmed_dups.clear();
+  }
   to_remove.swap(trimmed_dups);
   for (auto& t : trimmed) {
     string key = t.get_key_name();
@@ -898,7 +909,15 @@ void PGLog::_write_log_and_missing(
       ceph_assert(it != log_keys_debug->end());
       log_keys_debug->erase(it);
     }
-    to_remove.emplace(std::move(key));
+    if (!range_delete || trimmed.size() == 1) {
+      to_remove.emplace(std::move(key));
+    }
+  }
+  if (range_delete && trimmed.size() > 1) {
+    t.omap_rmkeyrange(
+      coll, log_oid,
+      trimmed.begin()->get_key_name(),
+      trimmed.rbegin()->get_key_name() + '\0');
   }
   trimmed.clear();
 
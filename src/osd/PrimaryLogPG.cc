@@ -1778,7 +1778,8 @@ PrimaryLogPG::PrimaryLogPG(OSDService *o, OSDMapRef curmap,
   pgbackend(
     PGBackend::build_pg_backend(
       _pool.info, ec_profile, this, coll_t(p), ch, o->store, cct, ec_extent_cache_lru)),
-  object_contexts(o->cct, o->cct->_conf->osd_pg_object_context_cache_count),
+  object_contexts_max(o->get_target_object_contexts()),
+  object_contexts(o->cct, object_contexts_max),
   new_backfill(false),
   temp_seq(0),
   snap_trimmer_machine(this)
@@ -1984,6 +1985,45 @@ void PrimaryLogPG::do_request(
   }
 }
 
+/*
+ * pg lock will be held.  Only plain overwrites of whole allocation units
+ * of an object whose context is cached qualify: anything else may read
+ * from the store (attrs on an obc miss, the old data for a partial
+ * overwrite) or do work of its own (tiering, hit sets).
+ */
+bool PrimaryLogPG::can_run_op_inline(OpRequestRef& op)
+{
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_nonconst_req());
+  ceph_assert(m->get_type() == CEPH_MSG_OSD_OP);
+  if (pool.info.cache_mode != pg_pool_t::CACHEMODE_NONE ||
+      pool.info.is_tier() ||
+      hit_set) {
+    return false;
+  }
+  uint64_t align = osd->store->get_min_alloc_size();
+  if (!align) {
+    return false;
+  }
+  if (m->finish_decode()) {
+    op->reset_desc();   // for TrackedOp
+    m->clear_payload();
+  }
+  uint64_t bytes = 0;
+  for (auto& o : m->ops) {
+    if (o.op.op != CEPH_OSD_OP_WRITE && o.op.op != CEPH_OSD_OP_WRITEFULL) {
+      return false;
+    }
+    if (o.op.extent.offset % align || o.op.extent.length % align) {
+      return false;
+    }
+    bytes += o.op.extent.length;
+  }
+  if (!bytes || !object_contexts.lookup(m->get_hobj().get_head())) {
+    return false;
+  }
+  return osd->store->can_queue_write_nowait(bytes);
+}
+
 /** do_op - do an op
  * pg lock will be held (if multithreaded)
  * osd_lock NOT held.
@@ -7796,12 +7836,11 @@ int PrimaryLogPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	}
 	tracepoint(osd, do_osd_op_pre_omapgetvals, soid.oid.name.c_str(), soid.snap.val, start_after.c_str(), max_return, filter_prefix.c_str());
 
-	uint32_t num = 0;
 	bool truncated = false;
-	bufferlist bl;
+	omap_batch_t vals;
 	if (oi.is_omap()) {
 	  using omap_iter_seek_t = ObjectStore::omap_iter_seek_t;
-	  const auto result = osd->store->omap_iterate(
+	  const auto result = osd->store->omap_get_range(
 	    ch, ghobject_t(soid),
 	    // try to seek as many keys-at-once as possible for the sake of performance.
 	    // note complexity should be logarithmic, so seek(n/2) + seek(n/2) is worse
@@ -7811,27 +7850,17 @@ int PrimaryLogPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	      .seek_type = filter_prefix > start_after ? omap_iter_seek_t::LOWER_BOUND
 						       : omap_iter_seek_t::UPPER_BOUND
 	    },
-	    [&bl, &truncated, &filter_prefix, &num, max_return,
-	     max_bytes=cct->_conf->osd_max_omap_bytes_per_request]
-	    (std::string_view key, std::string_view value) mutable {
-	      if (key.substr(0, filter_prefix.size()) != filter_prefix) {
-	        return ObjectStore::omap_iter_ret_t::STOP;
-	      }
-	      if (num >= max_return || bl.length() >= max_bytes) {
-	        truncated = true;
-	        return ObjectStore::omap_iter_ret_t::STOP;
-	      }
-	      encode(key, bl);
-	      encode(value, bl);
-	      ++num;
-	      return ObjectStore::omap_iter_ret_t::NEXT;
-	    });
+	    filter_prefix,
+	    max_return,
+	    cct->_conf->osd_max_omap_bytes_per_request,
+	    &vals);
 	  if (result < 0) {
 	    goto fail;
 	  }
+	  truncated = result > 0;
 	} // else return empty out_set
-	encode(num, osd_op.outdata);
-	osd_op.outdata.claim_append(bl);
+	// same encoding as a map<string,bufferlist>
+	encode(vals, osd_op.outdata);
 	encode(truncated, osd_op.outdata);
 	ctx->delta_stats.num_rd_kb += shift_round_up(osd_op.outdata.length(), 10);
 	ctx->delta_stats.num_rd++;
@@ -11933,6 +11962,15 @@ ObjectContextRef PrimaryLogPG::create_object_context(const object_info_t& oi,
   return obc;
 }
 
+bool PrimaryLogPG::need_snapset_attr(const hobject_t& soid)
+{
+  if (!soid.has_snapset()) {
+    return false;
+  }
+  std::lock_guard l(snapset_contexts_lock);
+  return !snapset_contexts.count(soid.get_snapdir());
+}
+
 ObjectContextRef PrimaryLogPG::get_object_context(
   const hobject_t& soid,
   bool can_create,
@@ -11953,14 +11991,39 @@ ObjectContextRef PrimaryLogPG::get_object_context(
 	     << dendl;
   } else {
     dout(10) << __func__ << ": obc NOT found in cache: " << soid << dendl;
+    // follow the per-osd budget as pgs come and go
+    if (unsigned target = osd->get_target_object_contexts();
+	target != object_contexts_max) {
+      object_contexts_max = target;
+      object_contexts.set_size(target);
+    }
     // check disk
     bufferlist bv;
+    map<string, bufferlist, less<>> disk_attrs;
     if (attrs) {
       auto it_oi = attrs->find(OI_ATTR);
       ceph_assert(it_oi != attrs->end());
       bv = it_oi->second;
     } else {
-      int r = pgbackend->objects_get_attr(soid, OI_ATTR, &bv);
+      int r;
+      if (pool.info.is_erasure() || need_snapset_attr(soid)) {
+	// we are going to need more than the object info; read all attrs
+	// at once instead of one by one
+	r = pgbackend->objects_get_attrs(soid, &disk_attrs);
+	if (r >= 0) {
+	  if (auto it_oi = disk_attrs.find(OI_ATTR);
+	      it_oi != disk_attrs.end()) {
+	    bv = it_oi->second;
+	    if (!soid.has_snapset() || disk_attrs.count(SS_ATTR)) {
+	      attrs = &disk_attrs;
+	    }
+	  } else {
+	    r = -ENOENT;
+	  }
+	}
+      } else {
+	r = pgbackend->objects_get_attr(soid, OI_ATTR, &bv);
+      }
       if (r < 0) {
 	if (!can_create) {
 	  dout(10) << __func__ << ": no obc for soid "
@@ -14448,6 +14511,7 @@ void PrimaryLogPG::scan_range_primary(
   ceph_assert(r >= 0);
   dout(10) << " got " << ls.size() << " items, next " << bi->end << dendl;
   dout(20) << ls << dendl;
+  pgbackend->objects_prefetch(ls);
 
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
@@ -14518,6 +14582,7 @@ void PrimaryLogPG::scan_range_replica(
   ceph_assert(r >= 0);
   dout(10) << " got " << ls.size() << " items, next " << bi->end << dendl;
   dout(20) << ls << dendl;
+  pgbackend->objects_prefetch(ls);
 
   for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
     handle.reset_tp_timeout();
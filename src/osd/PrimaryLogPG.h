@@ -1049,6 +1049,7 @@ protected:
   bool already_complete(eversion_t v);
 
   // projected object info
+  unsigned object_contexts_max; ///< current size limit of object_contexts
   SharedLRU<hobject_t, ObjectContext> object_contexts;
   // std::map from oid.snapdir() to SnapSetContext *
   std::map<hobject_t, SnapSetContext*> snapset_contexts;
@@ -1094,6 +1095,8 @@ protected:
     const std::map<std::string, ceph::buffer::list, std::less<>> *attrs = 0,
     bool oid_existed = true //indicate this oid whether exsited in backend
     );
+  /// true if loading soid's context would read its snapset from disk
+  bool need_snapset_attr(const hobject_t& soid);
   void register_snapset_context(SnapSetContext *ssc) {
     std::lock_guard l(snapset_contexts_lock);
     _register_snapset_context(ssc);
@@ -1554,6 +1557,7 @@ public:
   void do_request(
     OpRequestRef& op,
     ThreadPool::TPHandle &handle) override;
+  bool can_run_op_inline(OpRequestRef& op) override;
   void do_op(OpRequestRef& op);
   void record_write_error(OpRequestRef op, const hobject_t &soid,
 			  MOSDOpReply *orig_reply, int r,
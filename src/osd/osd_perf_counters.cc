@@ -132,6 +132,9 @@ PerfCounters *build_osd_logger(CephContext *cct) {
 
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_u64_counter(
+    l_osd_op_inline, "op_inline",
+    "Client operations run to completion on the dispatching thread");
 
 
   osd_plb.add_u64_counter(
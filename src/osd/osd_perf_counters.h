@@ -42,6 +42,7 @@ enum osd_counter_idx_t {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_inline,
 
   l_osd_replica_read,
   l_osd_replica_read_redirect_missing,
@@ -4878,10 +4878,10 @@ void ObjectCleanRegions::set_max_num_intervals(uint32_t num)
 void ObjectCleanRegions::trim()
 {
   while(clean_offsets.num_intervals() > max_num_intervals) {
-    typename interval_set<uint64_t>::iterator shortest_interval = clean_offsets.begin();
+    clean_offsets_t::iterator shortest_interval = clean_offsets.begin();
     if (shortest_interval == clean_offsets.end())
       break;
-    for (typename interval_set<uint64_t>::iterator it = clean_offsets.begin();
+    for (clean_offsets_t::iterator it = clean_offsets.begin();
         it != clean_offsets.end();
         ++it) {
       if (it.get_len() < shortest_interval.get_len())
@@ -4900,7 +4900,7 @@ void ObjectCleanRegions::merge(const ObjectCleanRegions &other)
 
 void ObjectCleanRegions::mark_data_region_dirty(uint64_t offset, uint64_t len)
 {
-  interval_set<uint64_t> clean_region;
+  clean_offsets_t clean_region;
   clean_region.insert(0, (uint64_t)-1);
   clean_region.erase(offset, len);
   clean_offsets.intersection_of(clean_region);
@@ -4931,9 +4931,13 @@ void ObjectCleanRegions::mark_fully_dirty()
 
 interval_set<uint64_t> ObjectCleanRegions::get_dirty_regions() const
 {
+   clean_offsets_t dirty;
+   dirty.insert(0, (uint64_t)-1);
+   dirty.subtract(clean_offsets);
    interval_set<uint64_t> dirty_region;
-   dirty_region.insert(0, (uint64_t)-1);
-   dirty_region.subtract(clean_offsets);
+   for (auto p = dirty.begin(); p != dirty.end(); ++p) {
+     dirty_region.insert(p.get_start(), p.get_len());
+   }
    return dirty_region;
 }
 
@@ -4248,9 +4248,16 @@ WRITE_CLASS_ENCODER(ObjectModDesc)
 
 class ObjectCleanRegions {
 private:
+  // every pg log and missing entry carries one of these, and it rarely
+  // holds more than one interval: keep it flat (no tree node per
+  // interval) and account it to the pg log
+  typedef interval_set<
+    uint64_t,
+    mempool::osd_pglog::flat_map> clean_offsets_t;
+
   bool new_object;
   bool clean_omap;
-  interval_set<uint64_t> clean_offsets;
+  clean_offsets_t clean_offsets;
   static std::atomic<uint32_t> max_num_intervals;
 
   /**
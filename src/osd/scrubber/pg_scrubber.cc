@@ -1377,6 +1377,7 @@ int PgScrubber::build_scrub_map_chunk(ScrubMap& map,
       break;
     }
     m_pg->_scan_rollback_obs(rollback_obs);
+    m_pg->get_pgbackend()->objects_prefetch(pos.ls);
     pos.pos = 0;
     return -EINPROGRESS;
   }
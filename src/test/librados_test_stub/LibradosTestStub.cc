@@ -1367,6 +1367,22 @@ int cls_cxx_map_get_vals(cls_method_context_t hctx, const string &start_obj,
   return vals->size();
 }
 
+int cls_cxx_map_get_vals(cls_method_context_t hctx, const string &start_obj,
+                         const string &filter_prefix, uint64_t max_to_get,
+                         omap_batch_t *vals, bool *more) {
+  std::map<string, bufferlist> m;
+  int r = cls_cxx_map_get_vals(hctx, start_obj, filter_prefix, max_to_get,
+                               &m, more);
+  if (r < 0) {
+    return r;
+  }
+  vals->clear();
+  for (auto& [k, v] : m) {
+    vals->append(k, v);
+  }
+  return vals->size();
+}
+
 int cls_cxx_map_remove_key(cls_method_context_t hctx, const string &key) {
   std::set<std::string> keys;
   keys.insert(key);
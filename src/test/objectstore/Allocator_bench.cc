@@ -4,7 +4,9 @@
  * In memory space allocator benchmarks.
  * Author: Igor Fedotov, ifedotov@suse.com
  */
+#include <deque>
 #include <iostream>
+#include <thread>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 
@@ -815,6 +817,176 @@ TEST_P(AllocTest, test_alloc_bench2_75_500_x2)
   doOverwriteMPC2Test(2, capacity, prefill, overwrite, 0.05);
 }
 
+TEST_P(AllocTest, test_alloc_contention_magazines)
+{
+  // skipping for legacy and slow code
+  if ((GetParam() == string("stupid"))) {
+    GTEST_SKIP() << "skipping for specific allocators";
+  }
+  const uint64_t capacity = 16ull * 1024 * _1m;
+  const uint64_t alloc_unit = 4096;
+  const size_t thread_count = 16;
+  const size_t ops_per_thread = 200000;
+  const size_t in_flight = 64;
+
+  auto run = [&](const char* magazines) {
+    g_ceph_context->_conf.set_val("bluestore_allocator_magazines", magazines);
+    g_ceph_context->_conf.apply_changes(nullptr);
+    alloc.reset(Allocator::add_magazines(
+      g_ceph_context,
+      Allocator::create(g_ceph_context, GetParam(), capacity, alloc_unit)));
+    alloc->init_add_free(0, capacity);
+    uint64_t free_before = alloc->get_free();
+
+    utime_t start = ceph_clock_now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; t++) {
+      threads.emplace_back([&] {
+        std::deque<bluestore_pextent_t> mine;
+        for (size_t i = 0; i < ops_per_thread; i++) {
+          PExtentVector tmp;
+          auto r = alloc->allocate(alloc_unit, alloc_unit, 0, -1, &tmp);
+          ASSERT_EQ((int64_t)alloc_unit, r);
+          mine.insert(mine.end(), tmp.begin(), tmp.end());
+          if (mine.size() > in_flight) {
+            interval_set<uint64_t> release_set;
+            release_set.insert(mine.front().offset, mine.front().length);
+            alloc->release(release_set);
+            mine.pop_front();
+          }
+        }
+        interval_set<uint64_t> release_set;
+        for (auto& e : mine) {
+          release_set.insert(e.offset, e.length);
+        }
+        alloc->release(release_set);
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    utime_t end = ceph_clock_now();
+    std::cout << GetParam() << " magazines=" << magazines << ": "
+              << thread_count * ops_per_thread << " alloc/release pairs in "
+              << (end - start) << std::endl;
+    // cached extents are still free space
+    ASSERT_EQ(free_before, alloc->get_free());
+    uint64_t reported = 0;
+    alloc->foreach([&](uint64_t offset, uint64_t length) {
+      reported += length;
+    });
+    ASSERT_EQ(free_before, reported);
+    alloc->shutdown();
+    init_close();
+  };
+  run("0");
+  run("16");
+  g_ceph_context->_conf.set_val("bluestore_allocator_magazines", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
+TEST_P(AllocTest, test_alloc_magazines_free_alloc_split)
+{
+  // skipping for legacy and slow code
+  if ((GetParam() == string("stupid"))) {
+    GTEST_SKIP() << "skipping for specific allocators";
+  }
+  // bluestore releases from the kv finalize thread while the shard
+  // threads allocate; freed units must find their way to the latter
+  const uint64_t capacity = 1024 * _1m;
+  const uint64_t alloc_unit = 4096;
+  const size_t thread_count = 8;
+  const size_t ops_per_thread = 100000;
+
+  auto run = [&](const char* magazines) {
+    g_ceph_context->_conf.set_val("bluestore_allocator_magazines", magazines);
+    g_ceph_context->_conf.apply_changes(nullptr);
+    alloc.reset(Allocator::add_magazines(
+      g_ceph_context,
+      Allocator::create(g_ceph_context, GetParam(), capacity, alloc_unit)));
+    alloc->init_add_free(0, capacity);
+
+    ceph::mutex lock = ceph::make_mutex("test_alloc_magazines_free_alloc_split");
+    ceph::condition_variable cond;
+    std::deque<uint64_t> to_free;
+    size_t allocators_done = 0;
+
+    utime_t start = ceph_clock_now();
+    std::thread releaser([&] {
+      std::unique_lock l(lock);
+      while (true) {
+        cond.wait(l, [&] {
+          return !to_free.empty() || allocators_done == thread_count;
+        });
+        if (to_free.empty()) {
+          break;
+        }
+        std::deque<uint64_t> batch;
+        batch.swap(to_free);
+        l.unlock();
+        for (auto o : batch) {
+          interval_set<uint64_t> release_set;
+          release_set.insert(o, alloc_unit);
+          alloc->release(release_set);
+        }
+        l.lock();
+      }
+    });
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; t++) {
+      threads.emplace_back([&] {
+        for (size_t i = 0; i < ops_per_thread; i++) {
+          PExtentVector tmp;
+          auto r = alloc->allocate(alloc_unit, alloc_unit, 0, -1, &tmp);
+          ASSERT_EQ((int64_t)alloc_unit, r);
+          std::lock_guard l(lock);
+          to_free.push_back(tmp.front().offset);
+          cond.notify_one();
+        }
+        std::lock_guard l(lock);
+        ++allocators_done;
+        cond.notify_one();
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    releaser.join();
+    utime_t end = ceph_clock_now();
+    std::cout << GetParam() << " magazines=" << magazines << ": "
+              << thread_count * ops_per_thread
+              << " allocs, released by one thread, in " << (end - start)
+              << std::endl;
+    ASSERT_EQ(capacity, alloc->get_free());
+
+    // units cached in magazines must not make larger allocations fail
+    PExtentVector all;
+    while (true) {
+      PExtentVector tmp;
+      auto r = alloc->allocate(alloc_unit, alloc_unit, 0, -1, &tmp);
+      if (r <= 0) {
+        break;
+      }
+      all.insert(all.end(), tmp.begin(), tmp.end());
+    }
+    ASSERT_EQ(capacity / alloc_unit, all.size());
+    for (auto& e : all) {
+      interval_set<uint64_t> release_set;
+      release_set.insert(e.offset, e.length);
+      alloc->release(release_set);
+    }
+    PExtentVector big;
+    ASSERT_EQ((int64_t)capacity, alloc->allocate(capacity, alloc_unit, 0, -1, &big));
+    alloc->release(big);
+    alloc->shutdown();
+    init_close();
+  };
+  run("0");
+  run("16");
+  g_ceph_context->_conf.set_val("bluestore_allocator_magazines", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 TEST_P(AllocTest, mempoolAccounting)
 {
   uint64_t bytes = mempool::bluestore_alloc::allocated_bytes();
@@ -1132,6 +1132,65 @@ TEST_P(StoreTest, BufferCacheReadTest) {
   }
 }
 
+TEST_P(StoreTest, ReadSharedBytesTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  auto ch = store->create_new_collection(cid);
+  const unsigned len = 0x10000;
+  bufferlist bl;
+  bl.append(std::string(len, 'x'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto shared = logger->get(l_bluestore_read_shared_bytes);
+  auto copied = logger->get(l_bluestore_read_copied_bytes);
+  {
+    // first read populates the buffer cache, second one hits it; both
+    // hand out references to the same data
+    for (int i = 0; i < 2; i++) {
+      bufferlist newdata;
+      r = store->read(ch, hoid, 0, len, newdata,
+		      CEPH_OSD_OP_FLAG_FADVISE_WILLNEED);
+      ASSERT_EQ(r, (int)len);
+      ASSERT_TRUE(bl_eq(bl, newdata));
+    }
+    ASSERT_EQ(shared + 2 * len, logger->get(l_bluestore_read_shared_bytes));
+    ASSERT_EQ(copied, logger->get(l_bluestore_read_copied_bytes));
+  }
+  {
+    // holes have to be zero-filled
+    ObjectStore::Transaction t;
+    t.truncate(cid, hoid, 2 * len);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    bufferlist newdata, expected;
+    r = store->read(ch, hoid, 0, 2 * len, newdata);
+    ASSERT_EQ(r, (int)(2 * len));
+    expected.append(bl);
+    expected.append_zero(len);
+    ASSERT_TRUE(bl_eq(expected, newdata));
+    ASSERT_EQ(shared + 3 * len, logger->get(l_bluestore_read_shared_bytes));
+    ASSERT_EQ(copied + len, logger->get(l_bluestore_read_copied_bytes));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 void StoreTest::doCompressionTest()
 {
   int r;
@@ -1370,6 +1429,26 @@ TEST_P(StoreTest, CompressionTest) {
   doCompressionTest();
 }
 
+TEST_P(StoreTestDeferredSetup, CompressionThreadsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_compression_threads", "2");
+  SetVal(g_conf(), "bluestore_compression_max_blob_size", "16384");
+  SetVal(g_conf(), "bluestore_compression_algorithm", "snappy");
+  SetVal(g_conf(), "bluestore_compression_mode", "force");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  DeferredSetup();
+  const PerfCounters* logger = store->get_perf_counters();
+  uint64_t queued = logger->get(l_bluestore_compress_pool_queued);
+  uint64_t compressed = logger->get(l_bluestore_compress_success_count);
+  doCompressionTest();
+  // the large writes span several 16k blobs, so they must have gone
+  // through the pool rather than the inline path
+  ASSERT_GT(logger->get(l_bluestore_compress_pool_queued), queued);
+  ASSERT_GT(logger->get(l_bluestore_compress_success_count), compressed);
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   int r;
   coll_t cid;
@@ -3781,6 +3860,80 @@ TEST_P(StoreTest, OmapSimple) {
   }
 }
 
+TEST_P(StoreTest, PrefetchTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  int r;
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  vector<ghobject_t> oids;
+  bufferlist header;
+  header.append("prefetched header");
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < 10; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("prefetch_" + stringify(i),
+					  CEPH_NOSNAP)));
+      t.touch(cid, hoid);
+      if (i % 2) {
+	t.omap_setheader(cid, hoid, header);
+      }
+      oids.push_back(hoid);
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // start with a cold onode cache
+  ch.reset();
+  r = store->umount();
+  ASSERT_EQ(0, r);
+  r = store->mount();
+  ASSERT_EQ(0, r);
+  ch = store->open_collection(cid);
+  ASSERT_TRUE(ch);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  auto prefetched = logger->get(l_bluestore_onode_prefetched);
+  vector<ghobject_t> hint = oids;
+  hint.push_back(ghobject_t(hobject_t(sobject_t("prefetch_none", CEPH_NOSNAP))));
+  store->prefetch(ch, hint);
+  ASSERT_EQ(prefetched + oids.size(),
+	    logger->get(l_bluestore_onode_prefetched));
+  // a second hint finds everything cached
+  store->prefetch(ch, hint);
+  ASSERT_EQ(prefetched + oids.size(),
+	    logger->get(l_bluestore_onode_prefetched));
+
+  for (unsigned i = 0; i < oids.size(); ++i) {
+    struct stat st;
+    ASSERT_EQ(0, store->stat(ch, oids[i], &st));
+    bufferlist h;
+    r = store->omap_get_header(ch, oids[i], &h);
+    ASSERT_EQ(0, r);
+    bufferlist expected;
+    if (i % 2) {
+      expected = header;
+    }
+    ASSERT_TRUE(bl_eq(expected, h));
+  }
+  ASSERT_FALSE(store->exists(ch, hint.back()));
+  {
+    ObjectStore::Transaction t;
+    for (auto& hoid : oids) {
+      t.remove(cid, hoid);
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, OmapCloneTest) {
   int r;
   coll_t cid;
@@ -6314,6 +6467,95 @@ TEST_P(StoreTest, OMapIterator) {
   }
 }
 
+TEST_P(StoreTest, OMapGetRange) {
+  coll_t cid;
+  ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  map<string, bufferlist> attrs;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, hoid);
+    for (unsigned i = 0; i < 100; ++i) {
+      char key[32];
+      snprintf(key, sizeof(key), "%s-%03u", (i % 2) ? "b" : "a", i);
+      bufferlist bl;
+      bl.append(string(i, 'x'));
+      attrs[key] = bl;
+    }
+    t.omap_setkeys(cid, hoid, attrs);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  using omap_iter_seek_t = ObjectStore::omap_iter_seek_t;
+  omap_batch_t batch;
+  // everything
+  r = store->omap_get_range(ch, hoid, omap_iter_seek_t::min_lower_bound(),
+			    "", 1000, 1 << 20, &batch);
+  ASSERT_EQ(0, r);
+  ASSERT_EQ(attrs.size(), batch.size());
+  {
+    size_t i = 0;
+    for (auto& [k, v] : attrs) {
+      ASSERT_EQ(k, batch.key(i));
+      bufferlist got = batch.value(i);
+      ASSERT_TRUE(v.contents_equal(got));
+      ++i;
+    }
+  }
+  // encodes like the equivalent map
+  {
+    bufferlist bl, mapbl;
+    encode(batch, bl);
+    encode(attrs, mapbl);
+    ASSERT_TRUE(bl.contents_equal(mapbl));
+    omap_batch_t decoded;
+    auto p = bl.cbegin();
+    decode(decoded, p);
+    ASSERT_EQ(batch.size(), decoded.size());
+    ASSERT_EQ(batch.key(batch.size() - 1), decoded.key(decoded.size() - 1));
+    ASSERT_EQ(50u, decoded.lower_bound("b"));
+  }
+  // prefix, upper bound and entry limit
+  r = store->omap_get_range(
+    ch, hoid,
+    omap_iter_seek_t{
+      .seek_position = "b-011",
+      .seek_type = omap_iter_seek_t::UPPER_BOUND
+    },
+    "b", 10, 1 << 20, &batch);
+  ASSERT_GT(r, 0);
+  ASSERT_EQ(10u, batch.size());
+  ASSERT_EQ("b-013", batch.key(0));
+  ASSERT_EQ("b-031", batch.key(9));
+  // the prefix ends the run without truncating it
+  r = store->omap_get_range(
+    ch, hoid,
+    omap_iter_seek_t{
+      .seek_position = "a-090",
+      .seek_type = omap_iter_seek_t::LOWER_BOUND
+    },
+    "a", 10, 1 << 20, &batch);
+  ASSERT_EQ(0, r);
+  ASSERT_EQ(5u, batch.size());
+  // byte limit
+  r = store->omap_get_range(ch, hoid, omap_iter_seek_t::min_lower_bound(),
+			    "", 1000, 1000, &batch);
+  ASSERT_GT(r, 0);
+  ASSERT_LT(batch.size(), attrs.size());
+  ASSERT_GE(batch.length(), 1000u);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, XattrTest) {
   coll_t cid;
   ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
@@ -9342,6 +9584,274 @@ TEST_P(StoreTestSpecificAUSize, DeferredAndClone2) {
   }
 }
 
+TEST_P(StoreTestSpecificAUSize, DeferredOnKVSyncLanes) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t alloc_size = 4096;
+  size_t prefer_deferred_size = 65536;
+  const unsigned num_colls = 6;
+  const unsigned num_writes = 32;
+
+  SetVal(g_conf(), "bluestore_kv_sync_lanes", "4");
+  SetVal(g_conf(), "bluestore_block_db_create", "true");
+  SetVal(g_conf(), "bluestore_block_db_size", stringify(1 << 30).c_str());
+
+  StartDeferred(alloc_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size",
+    stringify(prefer_deferred_size).c_str());
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+  std::vector<coll_t> cids;
+  std::vector<ObjectStore::CollectionHandle> chs;
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, 1), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, hoid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  // interleave small (deferred) overwrites across collections so that
+  // all the lanes are committing at once
+  for (unsigned w = 0; w < num_writes; ++w) {
+    std::vector<C_SaferCond> conds(num_colls);
+    for (unsigned i = 0; i < num_colls; ++i) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(alloc_size, 'a' + (w + i) % 26));
+      t.write(cids[i], hoid, w * alloc_size, bl.length(), bl,
+	      CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+      t.register_on_commit(&conds[i]);
+      r = store->queue_transaction(chs[i], std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    for (auto& c : conds) {
+      c.wait();
+    }
+  }
+  chs.clear();
+  CloseAndReopen();
+  for (unsigned i = 0; i < num_colls; ++i) {
+    auto ch = store->open_collection(cids[i]);
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, 0, num_writes * alloc_size, bl);
+    ASSERT_EQ(r, (int)(num_writes * alloc_size));
+    for (unsigned w = 0; w < num_writes; ++w) {
+      expected.append(std::string(alloc_size, 'a' + (w + i) % 26));
+    }
+    ASSERT_TRUE(bl_eq(expected, bl));
+
+    ObjectStore::Transaction t;
+    t.remove(cids[i], hoid);
+    t.remove_collection(cids[i]);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, DeferredCoalesce) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t alloc_size = 4096;
+  const unsigned num_colls = 4;
+  const unsigned num_writes = 16;
+
+  SetVal(g_conf(), "bluestore_deferred_coalesce", "true");
+  SetVal(g_conf(), "bluestore_deferred_max_merge_size", "8192");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "64");
+  SetVal(g_conf(), "bluestore_block_db_create", "true");
+  SetVal(g_conf(), "bluestore_block_db_size", stringify(1 << 30).c_str());
+
+  StartDeferred(alloc_size);
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  g_conf().apply_changes(nullptr);
+
+  int r;
+  ghobject_t hoid(hobject_t("test", "", CEPH_NOSNAP, 0, -1, ""));
+  std::vector<coll_t> cids;
+  std::vector<ObjectStore::CollectionHandle> chs;
+  for (unsigned i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, 1), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(std::string(num_writes * alloc_size, '-'));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  const PerfCounters* logger = store->get_perf_counters();
+  auto deferred_writes = logger->get(l_bluestore_submitted_deferred_writes);
+  // deferred overwrites from all collections pile up and get flushed
+  // together, in reverse offset order to give the elevator some work
+  for (unsigned w = num_writes; w-- > 0; ) {
+    for (unsigned i = 0; i < num_colls; ++i) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(alloc_size, 'a' + (w + i) % 26));
+      t.write(cids[i], hoid, w * alloc_size, bl.length(), bl,
+	      CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+      r = store->queue_transaction(chs[i], std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  }
+  for (auto& ch : chs) {
+    ch->flush();
+  }
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  bstore->deferred_try_submit();
+  std::cout << num_colls * num_writes << " deferred overwrites in "
+	    << logger->get(l_bluestore_submitted_deferred_writes) - deferred_writes
+	    << " writes" << std::endl;
+  chs.clear();
+  CloseAndReopen();
+  for (unsigned i = 0; i < num_colls; ++i) {
+    auto ch = store->open_collection(cids[i]);
+    bufferlist bl, expected;
+    r = store->read(ch, hoid, 0, num_writes * alloc_size, bl);
+    ASSERT_EQ(r, (int)(num_writes * alloc_size));
+    for (unsigned w = 0; w < num_writes; ++w) {
+      expected.append(std::string(alloc_size, 'a' + (w + i) % 26));
+    }
+    ASSERT_TRUE(bl_eq(expected, bl));
+
+    ObjectStore::Transaction t;
+    t.remove(cids[i], hoid);
+    t.remove_collection(cids[i]);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, AllocationJournalRestore) {
+
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  size_t alloc_size = 4096;
+  const unsigned num_objs = 256;
+
+  SetVal(g_conf(), "bluestore_allocation_journal", "true");
+  SetVal(g_conf(), "bluestore_allocation_journal_checkpoint_entries", "64");
+  SetVal(g_conf(), "bluestore_debug_inject_allocation_from_file_failure", "0");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(alloc_size);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  if (!bstore->has_null_manager()) {
+    GTEST_SKIP() << "allocation journal requires the NULL freelist manager";
+  }
+
+  int r;
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // build some fragmentation: write everything, then punch out every
+  // third object
+  auto oid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i), CEPH_NOSNAP)));
+  };
+  for (unsigned i = 0; i < num_objs; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(alloc_size * (1 + i % 7), 'a' + i % 26));
+    t.write(cid, oid(i), 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < num_objs; ++i) {
+    ObjectStore::Transaction t;
+    if (i % 3 != 0) {
+      continue;
+    }
+    t.remove(cid, oid(i));
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+
+  auto remount = [&](const char* journal) {
+    store->umount();
+    SetVal(g_conf(), "bluestore_allocation_journal", journal);
+    // pretend the allocation file was lost in a crash
+    SetVal(g_conf(), "bluestore_debug_inject_allocation_from_file_failure", "1");
+    g_conf().apply_changes(nullptr);
+    auto start = ceph::mono_clock::now();
+    r = store->mount();
+    auto lat = ceph::mono_clock::now() - start;
+    SetVal(g_conf(), "bluestore_debug_inject_allocation_from_file_failure", "0");
+    g_conf().apply_changes(nullptr);
+    return lat;
+  };
+  auto check = [&](unsigned i) {
+    bufferlist bl;
+    int r = store->read(ch, oid(i), 0, alloc_size, bl);
+    if (i % 3 != 2) {
+      ASSERT_EQ(r, -ENOENT);
+    } else {
+      bufferlist expected;
+      expected.append(std::string(alloc_size, 'a' + i % 26));
+      ASSERT_EQ(r, (int)alloc_size);
+      ASSERT_TRUE(bl_eq(expected, bl));
+    }
+  };
+
+  // without the journal recovery falls back to the full onode scan
+  auto scan_lat = remount("false");
+  ASSERT_EQ(r, 0);
+  // again a scan (there is no journal base yet) which leaves a base behind;
+  // then a few more journaled changes on top of it
+  remount("true");
+  ASSERT_EQ(r, 0);
+  ch = store->open_collection(cid);
+  for (unsigned i = 1; i < num_objs; i += 3) {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid(i));
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+
+  auto journal_lat = remount("true");
+  ASSERT_EQ(r, 0);
+  std::cout << "mount after lost allocation file: onode scan "
+	    << scan_lat << ", journal replay " << journal_lat << std::endl;
+  // anything the replay got wrong would hand out space still in use
+  ch = store->open_collection(cid);
+  for (unsigned i = 0; i < num_objs; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(std::string(alloc_size * 2, '#'));
+    t.write(cid, oid(num_objs + i), 0, bl.length(), bl);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < num_objs; ++i) {
+    check(i);
+  }
+  ch.reset();
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+}
+
 TEST_P(StoreTestSpecificAUSize, BlobReuseOnOverwriteReverse) {
 
   if (string(GetParam()) != "bluestore")
@@ -10256,6 +10766,103 @@ TEST_P(StoreTestSpecificAUSize, BluestoreRepairTest) {
   cerr << "Completing" << std::endl;
 }
 
+TEST_P(StoreTestSpecificAUSize, BluestoreParallelFsck) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  const size_t offs_base = 65536 / 2;
+
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_max_blob_size",
+    stringify(2 * offs_base).c_str());
+  SetVal(g_conf(), "bluestore_extent_map_shard_max_size", "12000");
+  SetVal(g_conf(), "bluestore_debug_inject_allocation_from_file_failure", "0");
+
+  StartDeferred(0x10000);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+
+  // a few collections, plenty of objects and some of them sharded
+  const uint64_t pool = 555;
+  const size_t num_colls = 4;
+  const size_t num_objs = 64;
+  const size_t repeats = 16;
+  bufferlist bl;
+  bl.append("1234512345");
+  int r;
+  std::vector<coll_t> cids;
+  for (size_t c = 0; c < num_colls; ++c) {
+    coll_t cid(spg_t(pg_t(c, pool), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 4);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    for (size_t o = 0; o < num_objs; ++o) {
+      ghobject_t hoid = make_object(("Object " + stringify(o)).c_str(), pool);
+      hoid.hobj.set_hash(c | (o << 4));
+      ObjectStore::Transaction t;
+      size_t n = o % 4 == 0 ? repeats : 1;
+      for (size_t i = 0; i < n; ++i) {
+        t.write(cid, hoid, i * offs_base, bl.length(), bl);
+      }
+      map<string, bufferlist> omap;
+      omap["key"] = bl;
+      t.omap_setkeys(cid, hoid, omap);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    cids.push_back(cid);
+  }
+  bstore->umount();
+
+  auto fsck_both = [&](bool deep) {
+    SetVal(g_conf(), "bluestore_fsck_threads", "0");
+    g_conf().apply_changes(nullptr);
+    int single = bstore->fsck(deep);
+    SetVal(g_conf(), "bluestore_fsck_threads", "4");
+    g_conf().apply_changes(nullptr);
+    int parallel = bstore->fsck(deep);
+    EXPECT_EQ(single, parallel);
+    return parallel;
+  };
+  ASSERT_EQ(fsck_both(false), 0);
+  ASSERT_EQ(fsck_both(true), 0);
+
+  // misreferenced extents must be found no matter which thread sees them
+  bstore->mount();
+  ghobject_t hoid = make_object("Object 0", pool);
+  hoid.hobj.set_hash(0);
+  ghobject_t hoid2 = make_object("Object 4", pool);
+  hoid2.hobj.set_hash(4 << 4);
+  bstore->inject_misreference(cids[0], hoid, cids[0], hoid2, 0);
+  bstore->inject_misreference(cids[0], hoid, cids[0], hoid2,
+    offs_base * (repeats - 1));
+  ghobject_t hoid3 = make_object("Object 8", pool);
+  hoid3.hobj.set_hash(1 | (8 << 4));
+  bstore->umount();
+  ASSERT_GT(fsck_both(false), 0);
+  ASSERT_GT(fsck_both(true), 0);
+
+  SetVal(g_conf(), "bluestore_fsck_threads", "4");
+  g_conf().apply_changes(nullptr);
+  ASSERT_EQ(bstore->repair(false), 0);
+  ASSERT_EQ(fsck_both(true), 0);
+
+  // a corrupted shard key is counted the same by the serial walk and
+  // by the per-object check of the parallel one
+  bstore->mount();
+  bstore->inject_stray_shard_key(cids[1], hoid3);
+  bstore->umount();
+  // shallow fsck doesn't look at shard keys at all
+  ASSERT_EQ(fsck_both(false), 0);
+  ASSERT_GT(fsck_both(true), 0);
+
+  SetVal(g_conf(), "bluestore_fsck_threads", "0");
+  g_conf().apply_changes(nullptr);
+  bstore->mount();
+}
+
 TEST_P(StoreTestSpecificAUSize, BluestoreBrokenZombieRepairTest) {
   if (string(GetParam()) != "bluestore")
     return;
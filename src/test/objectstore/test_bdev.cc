@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <fstream>
+#include <optional>
 #include <gtest/gtest.h>
 #include "global/global_init.h"
 #include "global/global_context.h"
@@ -11,8 +13,11 @@
 #include "common/ceph_argparse.h"
 #include "include/stringify.h"
 #include "common/errno.h"
+#include "common/perf_counters_collection.h"
+#include "include/scope_guard.h"
 
 #include "blk/BlockDevice.h"
+#include "blk/kernel/io_uring.h"
 
 using namespace std;
 
@@ -91,6 +96,276 @@ TEST(KernelDevice, Ticket45337) {
   b->close();
 }
 
+static uint64_t get_kernel_device_counter(const std::string& name)
+{
+  uint64_t v = 0;
+  g_ceph_context->get_perfcounters_collection()->with_counters(
+    [&](const auto& by_path) {
+      const std::string prefix = "blk-kernel-device-";
+      const std::string suffix = "." + name;
+      for (auto& [path, ref] : by_path) {
+        if (path.compare(0, prefix.size(), prefix) == 0 &&
+            path.size() > suffix.size() &&
+            path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+          v += ref.data->u64;
+        }
+      }
+    });
+  return v;
+}
+
+TEST(KernelDevice, IoringFixedBuffers) {
+  // aio reads landing in io_uring registered buffers
+  if (!ioring_queue_t::supported()) {
+    GTEST_SKIP() << "io_uring is not available";
+  }
+  uint64_t size = 1048576ull * 64;
+  TempBdev bdev{ size };
+
+  g_ceph_context->_conf.set_val("bdev_ioring", "true");
+  g_ceph_context->_conf.set_val("bdev_ioring_fixed_buffers", "4");
+  g_ceph_context->_conf.set_val("bdev_ioring_fixed_buffer_size", "65536");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  auto restore_conf = make_scope_guard([] {
+    g_ceph_context->_conf.set_val("bdev_ioring", "false");
+    g_ceph_context->_conf.set_val("bdev_ioring_fixed_buffers", "0");
+    g_ceph_context->_conf.apply_changes(nullptr);
+  });
+
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  {
+    int r = b->open(bdev.path);
+    if (r < 0) {
+      std::cerr << "open " << bdev.path << " failed" << std::endl;
+      return;
+    }
+  }
+  auto fixed_reads = get_kernel_device_counter("fixed_buffer_read_op");
+
+  const uint64_t len = 0x10000;
+  bufferlist bl;
+  for (uint64_t i = 0; i < len / 0x1000; i++) {
+    bl.append(string(0x1000, (char)('a' + i)));
+  }
+  {
+    std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+    bufferlist tmp = bl;
+    auto r = b->aio_write(0, tmp, ioc.get(), false);
+    ASSERT_EQ(r, 0);
+    if (ioc->has_pending_aios()) {
+      b->aio_submit(ioc.get());
+      ioc->aio_wait();
+    }
+  }
+  // more reads than registered buffers in flight at once
+  for (unsigned round = 0; round < 2; round++) {
+    std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+    std::vector<bufferlist> out(len / 0x1000);
+    for (uint64_t i = 0; i < out.size(); i++) {
+      auto r = b->aio_read(i * 0x1000, 0x1000, &out[i], ioc.get());
+      ASSERT_EQ(r, 0);
+    }
+    if (ioc->has_pending_aios()) {
+      b->aio_submit(ioc.get());
+      ioc->aio_wait();
+    }
+    for (uint64_t i = 0; i < out.size(); i++) {
+      bufferlist expected;
+      expected.substr_of(bl, i * 0x1000, 0x1000);
+      ASSERT_TRUE(expected.contents_equal(out[i]));
+    }
+  }
+  // the reads must really have landed in the registered buffers
+  ASSERT_GT(get_kernel_device_counter("fixed_buffer_read_op"), fixed_reads);
+  b->close();
+}
+
+TEST(KernelDevice, DeferredDiscard) {
+  // a discard queued while aio is in flight is held back, but for no
+  // longer than bdev_async_discard_defer_max_ms
+  uint64_t size = 1048576ull * 64;
+  TempBdev bdev{ size };
+  const uint64_t max_ms = 200;
+  const uint64_t aio_sleep_ms = 3000;
+
+  g_ceph_context->_conf.set_val("bdev_enable_discard", "true");
+  g_ceph_context->_conf.set_val("bdev_async_discard_threads", "1");
+  g_ceph_context->_conf.set_val("bdev_async_discard_defer_max_ms", stringify(max_ms));
+  g_ceph_context->_conf.set_val("bdev_async_discard_defer_inflight", "1");
+  g_ceph_context->_conf.set_val("bdev_debug_aio_complete_sleep", stringify(aio_sleep_ms));
+  g_ceph_context->_conf.apply_changes(nullptr);
+  auto restore_conf = make_scope_guard([] {
+    g_ceph_context->_conf.set_val("bdev_enable_discard", "false");
+    g_ceph_context->_conf.set_val("bdev_async_discard_threads", "0");
+    g_ceph_context->_conf.set_val("bdev_async_discard_defer_max_ms", "0");
+    g_ceph_context->_conf.set_val("bdev_async_discard_defer_inflight", "16");
+    g_ceph_context->_conf.set_val("bdev_debug_aio_complete_sleep", "0");
+    g_ceph_context->_conf.apply_changes(nullptr);
+  });
+
+  struct discarded_t {
+    ceph::mutex lock = ceph::make_mutex("discarded_t::lock");
+    ceph::condition_variable cond;
+    std::optional<ceph::mono_time> when;
+  } discarded;
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {
+        auto d = static_cast<discarded_t*>(handle);
+        std::lock_guard l(d->lock);
+        d->when = ceph::mono_clock::now();
+        d->cond.notify_all();
+      }, &discarded));
+  {
+    int r = b->open(bdev.path);
+    if (r < 0) {
+      std::cerr << "open " << bdev.path << " failed" << std::endl;
+      return;
+    }
+  }
+  if (!b->is_discard_supported()) {
+    b->close();
+    GTEST_SKIP() << "discard is not supported on " << bdev.path;
+  }
+  auto deferred = get_kernel_device_counter("discard_deferred");
+
+  // the aio completion is held up, so it stays in flight for aio_sleep_ms
+  std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+  bufferlist bl;
+  bl.append(string(0x10000, 'a'));
+  ASSERT_EQ(0, b->aio_write(0, bl, ioc.get(), false));
+  ASSERT_TRUE(ioc->has_pending_aios());
+  b->aio_submit(ioc.get());
+
+  auto queued = ceph::mono_clock::now();
+  interval_set<uint64_t> to_release;
+  to_release.insert(0x100000, 0x100000);
+  ASSERT_TRUE(b->try_discard(to_release));
+  {
+    std::unique_lock l(discarded.lock);
+    ASSERT_TRUE(discarded.cond.wait_for(
+      l, std::chrono::milliseconds(aio_sleep_ms),
+      [&] { return discarded.when.has_value(); }));
+    auto lat = *discarded.when - queued;
+    ASSERT_GE(lat, std::chrono::milliseconds(max_ms));
+    ASSERT_LT(lat, std::chrono::milliseconds(aio_sleep_ms));
+  }
+  ASSERT_GT(get_kernel_device_counter("discard_deferred"), deferred);
+  ioc->aio_wait();
+  b->close();
+}
+
+#ifdef HAVE_SPDK
+TEST(NVMEDevice, ZeroCopyIO) {
+  // needs an NVMe controller reachable through SPDK, e.g. an nvmf_tgt
+  // exporting a malloc or aio (file backed) bdev over TCP:
+  // CEPH_TEST_SPDK_TRID="trtype:TCP adrfam:IPv4 traddr:127.0.0.1
+  //                      trsvcid:4420 subnqn:nqn.2016-06.io.spdk:cnode1"
+  const char *trid = getenv("CEPH_TEST_SPDK_TRID");
+  if (!trid) {
+    GTEST_SKIP() << "CEPH_TEST_SPDK_TRID not set";
+  }
+  string target = SPDK_PREFIX "ceph_test_bdev." + stringify(getpid());
+  string path = "ceph_test_bdev.spdk." + stringify(getpid());
+  {
+    std::ofstream f(target);
+    f << trid << std::endl;
+  }
+  ASSERT_EQ(0, ::symlink(target.c_str(), path.c_str()));
+  auto cleanup = make_scope_guard([&] {
+    ::unlink(path.c_str());
+    ::unlink(target.c_str());
+  });
+
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  ASSERT_EQ(0, b->open(path));
+
+  const uint64_t len = 0x40000; // spans two 128KB tasks
+  bufferlist bl;
+  for (uint64_t i = 0; i < len / 0x1000; i++) {
+    bl.append(string(0x1000, (char)('a' + i % 26)));
+  }
+  for (auto zero_copy : {"false", "true"}) {
+    g_ceph_context->_conf.set_val("bluestore_spdk_zero_copy", zero_copy);
+    g_ceph_context->_conf.apply_changes(nullptr);
+    {
+      bufferlist tmp = bl;
+      ASSERT_EQ(0, b->write(0, tmp, false));
+    }
+    bufferlist out;
+    {
+      std::unique_ptr<IOContext> ioc(new IOContext(g_ceph_context, NULL));
+      ASSERT_EQ(0, b->aio_read(0, len, &out, ioc.get()));
+      b->aio_submit(ioc.get());
+      ioc->aio_wait();
+    }
+    ASSERT_TRUE(bl.contents_equal(out));
+    // write back what was read; with zero copy on this is already
+    // DMA memory and goes out without a bounce buffer
+    {
+      bufferlist tmp = out;
+      ASSERT_EQ(0, b->write(len, tmp, false));
+    }
+    bufferlist out2;
+    ASSERT_EQ(0, b->read(len, len, &out2, nullptr, false));
+    ASSERT_TRUE(bl.contents_equal(out2));
+    char buf[0x1000];
+    ASSERT_EQ(0, b->read_random(0x800, sizeof(buf), buf, false));
+    bufferlist expected;
+    expected.substr_of(bl, 0x800, sizeof(buf));
+    ASSERT_EQ(0, memcmp(expected.c_str(), buf, sizeof(buf)));
+  }
+  b->close();
+}
+#endif
+
+#ifdef HAVE_BLUESTORE_PMEM
+TEST(PMEMDevice, FileBackedWrite) {
+  // a plain file is not mapped as pmem, so writes go through the msync
+  // path; run with PMEM_IS_PMEM_FORCE=1 to exercise the pmem one
+  TempBdev bdev{ 16 * 1024 * 1024 };
+  g_ceph_context->_conf.set_val("bdev_type", "pmem");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  auto restore = make_scope_guard([&] {
+    g_ceph_context->_conf.rm_val("bdev_type");
+    g_ceph_context->_conf.apply_changes(nullptr);
+  });
+
+  std::unique_ptr<BlockDevice> b(
+    BlockDevice::create(g_ceph_context, bdev.path, NULL, NULL,
+      [](void* handle, void* aio) {}, NULL));
+  ASSERT_EQ(0, b->open(bdev.path));
+
+  // a write made of several segments is persisted as a whole
+  const uint64_t len = 0x10000;
+  bufferlist bl;
+  for (uint64_t i = 0; i < len / 0x1000; i++) {
+    bl.append(string(0x1000, (char)('a' + i % 26)));
+  }
+  {
+    bufferlist tmp = bl;
+    ASSERT_EQ(0, b->write(0x1000, tmp, false));
+  }
+  ASSERT_EQ(0, b->flush());
+  bufferlist out;
+  ASSERT_EQ(0, b->read(0x1000, len, &out, nullptr, false));
+  ASSERT_TRUE(bl.contents_equal(out));
+  b->close();
+
+  // and is visible through the file once the device is gone
+  int fd = ::open(bdev.path.c_str(), O_RDONLY);
+  ASSERT_LE(0, fd);
+  std::string buf(len, 0);
+  ASSERT_EQ((ssize_t)len, ::pread(fd, buf.data(), len, 0x1000));
+  ::close(fd);
+  ASSERT_EQ(0, memcmp(bl.c_str(), buf.data(), len));
+}
+#endif
+
 int main(int argc, char **argv) {
   auto args = argv_to_vec(argc, argv);
   map<string,string> defaults = {
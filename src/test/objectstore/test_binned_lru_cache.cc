@@ -0,0 +1,157 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/ceph_time.h"
+#include "global/global_context.h"
+#include "include/ceph_hash.h"
+#include "kv/rocksdb_cache/BinnedLRUCache.h"
+
+using namespace std;
+using ceph::mono_clock;
+using rocksdb_cache::BinnedLRUCacheShard;
+
+static uint32_t key_hash(const string& key)
+{
+  return ceph_str_hash_rjenkins(key.data(), key.size());
+}
+
+// look key up, inserting it on a miss; return true on a hit
+static bool access(BinnedLRUCacheShard& shard, const string& key,
+		   size_t charge = 1)
+{
+  uint32_t hash = key_hash(key);
+  auto h = shard.Lookup(key, hash);
+  if (h) {
+    shard.Release(h);
+    return true;
+  }
+  auto s = shard.Insert(key, hash, nullptr, charge, nullptr, nullptr,
+			rocksdb::Cache::Priority::LOW);
+  ceph_assert(s.ok());
+  return false;
+}
+
+TEST(BinnedLRUCache, ProbationKeepsWorkingSet)
+{
+  for (double ratio : {0.0, 0.25}) {
+    BinnedLRUCacheShard shard(g_ceph_context, 100, false, 0.0, ratio);
+    // a working set that is read twice...
+    for (unsigned pass = 0; pass < 2; ++pass) {
+      for (unsigned i = 0; i < 50; ++i) {
+	access(shard, "hot" + to_string(i));
+      }
+    }
+    // ...followed by a scan much larger than the cache
+    for (unsigned i = 0; i < 1000; ++i) {
+      access(shard, "scan" + to_string(i));
+    }
+    unsigned hits = 0;
+    for (unsigned i = 0; i < 50; ++i) {
+      hits += access(shard, "hot" + to_string(i));
+    }
+    if (ratio > 0) {
+      ASSERT_EQ(50u, hits);
+      ASSERT_LE(shard.GetProbationUsage(), 50u);
+    } else {
+      ASSERT_EQ(0u, hits);
+      ASSERT_EQ(0u, shard.GetProbationUsage());
+    }
+    ASSERT_EQ(100u, shard.GetUsage());
+  }
+}
+
+TEST(BinnedLRUCache, ProbationGhostAdmission)
+{
+  BinnedLRUCacheShard shard(g_ceph_context, 100, false, 0.0, 0.25);
+  for (unsigned i = 0; i < 100; ++i) {
+    access(shard, "a" + to_string(i));
+  }
+  // push "a0" out of probation; it should be remembered in the ghost list
+  for (unsigned i = 0; i < 10; ++i) {
+    access(shard, "b" + to_string(i));
+  }
+  ASSERT_FALSE(access(shard, "a0"));
+  // inserted straight into the main pool this time, so it survives
+  // another round of probation churn
+  for (unsigned i = 0; i < 200; ++i) {
+    access(shard, "c" + to_string(i));
+  }
+  ASSERT_TRUE(access(shard, "a0"));
+}
+
+// Replays a key trace against caches with different probation ratios and
+// reports the hit rate of each.  CEPH_TEST_CACHE_TRACE may name a file
+// with one "<key> [<charge>]" per line (e.g. extracted from a block cache
+// trace); otherwise a skewed working set interleaved with large scans is
+// used.
+TEST(BinnedLRUCache, HitRateBenchmark)
+{
+  vector<pair<string, size_t>> trace;
+  size_t capacity = 1000;
+  const char *fn = getenv("CEPH_TEST_CACHE_TRACE");
+  if (fn) {
+    ifstream in(fn);
+    ASSERT_TRUE(in.good()) << "cannot open " << fn;
+    string line;
+    size_t total = 0;
+    while (getline(in, line)) {
+      istringstream is(line);
+      string key;
+      size_t charge = 1;
+      if (!(is >> key)) {
+	continue;
+      }
+      is >> charge;
+      trace.emplace_back(key, charge);
+      total += charge;
+    }
+    const char *cap = getenv("CEPH_TEST_CACHE_CAPACITY");
+    capacity = cap ? strtoull(cap, nullptr, 10) : total / 10;
+  } else {
+    mt19937 rng(0);
+    vector<double> weights;
+    for (unsigned i = 0; i < 2000; ++i) {
+      weights.push_back(1.0 / (i + 1));
+    }
+    discrete_distribution<unsigned> hot(weights.begin(), weights.end());
+    unsigned scanned = 0;
+    for (unsigned round = 0; round < 10; ++round) {
+      for (unsigned i = 0; i < 20000; ++i) {
+	trace.emplace_back("hot" + to_string(hot(rng)), 1);
+      }
+      for (unsigned i = 0; i < 5000; ++i) {
+	trace.emplace_back("scan" + to_string(scanned++), 1);
+      }
+    }
+  }
+
+  map<double, double> hit_rate;
+  for (double ratio : {0.0, 0.05, 0.1, 0.25, 0.5}) {
+    BinnedLRUCacheShard shard(g_ceph_context, capacity, false, 0.0, ratio);
+    uint64_t hits = 0;
+    auto start = mono_clock::now();
+    for (auto& [key, charge] : trace) {
+      hits += access(shard, key, charge);
+    }
+    auto elapsed = mono_clock::now() - start;
+    hit_rate[ratio] = (double)hits / trace.size();
+    cout << "probation_ratio " << ratio
+	 << " capacity " << capacity
+	 << " accesses " << trace.size()
+	 << " hit rate " << hit_rate[ratio]
+	 << " in " << std::chrono::duration<double>(elapsed).count() << "s"
+	 << std::endl;
+  }
+  if (!fn) {
+    ASSERT_GT(hit_rate[0.1], hit_rate[0.0]);
+  }
+}
@@ -1999,6 +1999,78 @@ TEST(BlueFS, test_concurrent_dir_link_and_compact_log_56210) {
   }
 }
 
+TEST(BlueFS, test_concurrent_fsync_batching) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_alloc_size", "65536");
+  conf.SetVal("bluefs_log_sync_batch_us", "500");
+  conf.ApplyChanges();
+
+  const int num_threads = 8;
+  const int num_fsyncs = 100;
+  const size_t chunk = 4096;
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+
+  // hold the first two fsyncs that want a log sync until both have
+  // dirtied the log; whichever syncs first then covers the other one
+  ceph::mutex lock = ceph::make_mutex("test_concurrent_fsync_batching");
+  ceph::condition_variable cond;
+  int arrived = 0;
+  fs.tracepoint_log_sync = [&](uint64_t want_seq) {
+    if (!want_seq) {
+      return;
+    }
+    std::unique_lock l(lock);
+    if (arrived >= 2) {
+      return;
+    }
+    if (++arrived == 2) {
+      cond.notify_all();
+    }
+    cond.wait(l, [&] { return arrived >= 2; });
+  };
+  {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([&fs, i] {
+        BlueFS::FileWriter *h;
+        ASSERT_EQ(0, fs.open_for_write("dir", "file" + std::to_string(i), &h, false));
+        std::string data(chunk, 'a' + i);
+        for (int j = 0; j < num_fsyncs; j++) {
+          h->append(data.c_str(), data.size());
+          fs.fsync(h);
+        }
+        fs.close_writer(h);
+      });
+    }
+    join_all(threads);
+  }
+  fs.tracepoint_log_sync = nullptr;
+  auto *logger = fs.get_perf_counters();
+  std::cout << num_threads * num_fsyncs << " fsyncs, "
+            << logger->get(l_bluefs_log_write_count) << " log writes, "
+            << logger->get(l_bluefs_log_sync_coalesced) << " coalesced"
+            << std::endl;
+  ASSERT_GT(logger->get(l_bluefs_log_sync_coalesced), 0u);
+  fs.umount();
+
+  // everything fsynced must survive the remount
+  ASSERT_EQ(0, fs.mount());
+  for (int i = 0; i < num_threads; i++) {
+    uint64_t file_size;
+    utime_t mtime;
+    ASSERT_EQ(0, fs.stat("dir", "file" + std::to_string(i), &file_size, &mtime));
+    ASSERT_EQ(num_fsyncs * chunk, file_size);
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, truncate_drops_allocations) {
   constexpr uint64_t K = 1024;
   constexpr uint64_t M = 1024 * K;
@@ -417,6 +417,74 @@ TEST(bluestore_blob_t, csum_bench) {
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_fragmented) {
+  // blocks straddling buffer::ptr boundaries must hash the same as
+  // blocks handed to the contiguous multi-block kernels
+  const unsigned len = 65536;
+  bufferptr bp(len);
+  for (unsigned i = 0; i < len; ++i)
+    bp.c_str()[i] = (i * 7 + (i >> 9)) & 0xff;
+  bufferlist contig;
+  contig.append(bp);
+  bufferlist frag;
+  for (unsigned off = 0, piece = 1000; off < len; off += piece) {
+    piece = std::min(piece, len - off);
+    frag.append(bufferptr(bp.c_str() + off, piece));
+  }
+  ASSERT_GT(frag.get_num_buffers(), 1u);
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX; ++csum_type) {
+    bluestore_blob_t a, b;
+    a.init_csum(csum_type, 12, len);
+    b.init_csum(csum_type, 12, len);
+    a.calc_csum(0, contig);
+    b.calc_csum(0, frag);
+    ASSERT_EQ(a.csum_data.length(), b.csum_data.length());
+    ASSERT_EQ(0, memcmp(a.csum_data.c_str(), b.csum_data.c_str(),
+                        a.csum_data.length()));
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, a.verify_csum(0, frag, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+
+    bufferlist corrupt;
+    corrupt.append(frag);
+    corrupt.rebuild();
+    corrupt.c_str()[5 * 4096 + 17] ^= 1;
+    ASSERT_EQ(-1, a.verify_csum(0, corrupt, &bad_off, &bad_csum));
+    ASSERT_EQ(5 * 4096, bad_off);
+  }
+}
+
+TEST(bluestore_blob_t, csum_bench_fragmented) {
+  bufferptr bp(10485760);
+  for (char *a = bp.c_str(); a < bp.c_str() + bp.length(); ++a)
+    *a = (unsigned long)a & 0xff;
+  // mimic a messenger-assembled payload: pieces that are not csum aligned
+  bufferlist bl;
+  for (unsigned off = 0, piece = 65536 + 512; off < bp.length(); off += piece) {
+    piece = std::min<unsigned>(piece, bp.length() - off);
+    bl.append(bufferptr(bp, off, piece));
+  }
+  int count = 256;
+  for (unsigned csum_type = 1; csum_type < Checksummer::CSUM_MAX; ++csum_type) {
+    bluestore_blob_t b;
+    b.init_csum(csum_type, 12, bl.length());
+    ceph::mono_clock::time_point start = ceph::mono_clock::now();
+    for (int i = 0; i < count; ++i) {
+      b.calc_csum(0, bl);
+    }
+    ceph::mono_clock::time_point end = ceph::mono_clock::now();
+    auto dur = std::chrono::duration_cast<ceph::timespan>(end - start);
+    double mbsec = (double)count * (double)bl.length() / 1000000.0 /
+                   (double)dur.count() * 1000000000.0;
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type) << ", "
+         << dur << " seconds, " << mbsec << " MB/sec" << std::endl;
+  }
+}
+
 TEST(Blob, put_ref) {
   {
     BlueStore store(g_ceph_context, "", 4096);
@@ -2656,6 +2724,122 @@ void clear_and_dispose(BlueStore::old_extent_map_t &old_em) {
   }
 }
 
+TEST(OnodeCacheShard, clock) {
+  BlueStore store(g_ceph_context, "", 4096);
+  std::unique_ptr<BlueStore::OnodeCacheShard> oc{
+      BlueStore::OnodeCacheShard::create(g_ceph_context, "clock", NULL)};
+  std::unique_ptr<BlueStore::BufferCacheShard> bc{
+      BlueStore::BufferCacheShard::create(&store, "lru", NULL)};
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc.get(), bc.get(), coll_t());
+
+  std::vector<ghobject_t> oids;
+  BlueStore::OnodeRef pinned;
+  oc->set_max(100);
+  for (int i = 0; i < 10; i++) {
+    ghobject_t oid(hobject_t(sobject_t("obj" + std::to_string(i), CEPH_NOSNAP)));
+    BlueStore::OnodeRef o = new BlueStore::Onode(coll.get(), oid, "");
+    o->exists = true;
+    o = coll->onode_space.add_onode(oid, o);
+    if (i == 0) {
+      pinned = o;
+    }
+    oids.push_back(oid);
+  }
+  ASSERT_EQ(10u, oc->_get_num());
+  auto is_cached = [&](int i) {
+    return coll->onode_space.map_any([&](BlueStore::Onode* o) {
+      return o->oid == oids[i];
+    });
+  };
+
+  // everything was referenced on insertion, so the hand needs a full
+  // round before evicting; the pinned onode survives
+  oc->set_max(5);
+  oc->trim();
+  ASSERT_EQ(5u, oc->_get_num());
+  ASSERT_TRUE(is_cached(0));
+  for (int i = 1; i <= 5; i++) {
+    ASSERT_FALSE(is_cached(i));
+  }
+
+  // a hit (pin + unpin) gives obj6 a second chance
+  coll->onode_space.map_any([&](BlueStore::Onode* o) {
+    if (o->oid == oids[6]) {
+      BlueStore::OnodeRef hit(o);
+    }
+    return false;
+  });
+  oc->set_max(3);
+  oc->trim();
+  ASSERT_EQ(3u, oc->_get_num());
+  ASSERT_TRUE(is_cached(0));
+  ASSERT_TRUE(is_cached(6));
+  ASSERT_FALSE(is_cached(7));
+  ASSERT_FALSE(is_cached(8));
+  ASSERT_TRUE(is_cached(9));
+
+  pinned.reset();
+  oc->flush();
+  ASSERT_EQ(0u, oc->_get_num());
+}
+
+TEST(ExtentMap, unload_clean_shards) {
+  BlueStore store(g_ceph_context, "", 4096);
+  std::unique_ptr<BlueStore::OnodeCacheShard> oc{
+      BlueStore::OnodeCacheShard::create(g_ceph_context, "lru", NULL)};
+  std::unique_ptr<BlueStore::BufferCacheShard> bc{
+      BlueStore::BufferCacheShard::create(&store, "lru", NULL)};
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc.get(), bc.get(), coll_t());
+
+  const unsigned num_shards = 4;
+  const uint32_t shard_size = 0x100000;
+  const uint32_t extent_size = 0x1000;
+  BlueStore::Onode onode(coll.get(), ghobject_t(), "");
+  for (unsigned i = 0; i < num_shards; ++i) {
+    onode.onode.extent_map_shards.emplace_back();
+    onode.onode.extent_map_shards.back().offset = i * shard_size;
+  }
+  auto& em = onode.extent_map;
+  em.init_shards(true, false);
+  for (uint32_t off = 0; off < num_shards * shard_size; off += extent_size) {
+    BlueStore::BlobRef b(coll->new_blob());
+    em.extent_map.insert(*new BlueStore::Extent(off, 0, extent_size, b));
+  }
+  for (unsigned i = 0; i < num_shards; ++i) {
+    em.shards[i].extents = shard_size / extent_size;
+  }
+  em.shards[1].dirty = true;
+
+  uint64_t before = mempool::bluestore_extent::allocated_bytes() +
+    mempool::bluestore_cache_meta::allocated_bytes();
+  ASSERT_EQ(num_shards - 1, em.unload_clean_shards());
+  uint64_t after = mempool::bluestore_extent::allocated_bytes() +
+    mempool::bluestore_cache_meta::allocated_bytes();
+  cout << "onode with " << num_shards * shard_size / extent_size
+       << " extents: " << before << " bytes, " << after
+       << " bytes with clean shards unloaded" << std::endl;
+  ASSERT_LT(after, before);
+
+  // only the dirty shard keeps its extents
+  ASSERT_EQ(shard_size / extent_size, em.extent_map.size());
+  for (auto& e : em.extent_map) {
+    ASSERT_GE(e.logical_offset, shard_size);
+    ASSERT_LT(e.logical_offset, 2 * shard_size);
+  }
+  for (unsigned i = 0; i < num_shards; ++i) {
+    ASSERT_EQ(i == 1, em.shards[i].loaded);
+  }
+  ASSERT_EQ(0u, em.unload_clean_shards());
+
+  // a pending reshard means shard boundaries can't be trusted
+  em.shards[1].dirty = false;
+  em.request_reshard(0, shard_size);
+  ASSERT_EQ(0u, em.unload_clean_shards());
+  em.clear_needs_reshard();
+  ASSERT_EQ(1u, em.unload_clean_shards());
+  ASSERT_TRUE(em.extent_map.empty());
+}
+
 TEST(GarbageCollector, BasicTest) {
   BlueStore store(g_ceph_context, "", 4096);
   std::unique_ptr<BlueStore::OnodeCacheShard> oc{
@@ -359,6 +359,45 @@ TEST_P(KVTest, ShardingRMRange) {
 }
 
 
+TEST_P(KVTest, MultiGet) {
+  if (string(GetParam()) == "rocksdb") {
+    ASSERT_EQ(0, db->create_and_open(cout, "O(7)="));
+  } else {
+    ASSERT_EQ(0, db->create_and_open(cout));
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (size_t i = 0; i < 100; i += 2) {
+      bufferlist value;
+      value.append(stringify(i));
+      t->set("O", "key" + stringify(i), value);
+      t->set("prefix", "key" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  for (auto prefix : {"O", "prefix", "missing"}) {
+    std::vector<string> keys;
+    for (size_t i = 0; i < 100; i++) {
+      keys.push_back("key" + stringify(i));
+    }
+    std::vector<bufferlist> values;
+    std::vector<int> rs;
+    db->multi_get(prefix, keys, &values, &rs);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), rs.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i % 2 == 0 && string(prefix) != "missing") {
+	ASSERT_EQ(0, rs[i]);
+	ASSERT_EQ(stringify(i), _bl_to_str(values[i]));
+      } else {
+	ASSERT_EQ(-ENOENT, rs[i]);
+	ASSERT_EQ(0u, values[i].length());
+      }
+    }
+  }
+  fini();
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -519,6 +519,64 @@ TEST_F(OSDMapTest, MapPG) {
   ASSERT_EQ(osdmap.get_pg_pool(my_rep_pool)->get_size(), up_osds.size());
 }
 
+TEST_F(OSDMapTest, PGMappingPrecalc) {
+  set_up_map();
+  auto map = std::make_shared<OSDMap>();
+  map->deepish_copy_from(osdmap);
+  const epoch_t e = map->get_epoch();
+
+  // all but the last pg; that one stands for a pg split off later
+  unsigned pg_num = map->get_pg_pool(my_rep_pool)->get_pg_num();
+  ASSERT_GT(pg_num, 1u);
+  std::set<pg_t> pgids;
+  for (unsigned ps = 0; ps < pg_num - 1; ++ps) {
+    pgids.insert(pg_t(ps, my_rep_pool));
+  }
+  pg_t later(pg_num - 1, my_rep_pool);
+
+  ThreadPool tp(g_ceph_context, "PGMappingPrecalc::tp", "tp_pgmap", 2);
+  ParallelPGMapper mapper(g_ceph_context, &tp);
+  {
+    PGMappingPrecalc precalc(&mapper);
+    vector<int> up, acting;
+    int up_primary, acting_primary;
+
+    // the pool is not running yet, so the job stays pending
+    precalc.queue(e, map, pgids, 4);
+    ASSERT_EQ(1u, precalc.size());
+    ASSERT_FALSE(precalc.get(e, *pgids.begin(), &up, &up_primary,
+			     &acting, &acting_primary));
+
+    // once it completes every queued pg maps like CRUSH does
+    tp.start();
+    mapper.drain();
+    for (auto& pgid : pgids) {
+      ASSERT_TRUE(precalc.get(e, pgid, &up, &up_primary,
+			      &acting, &acting_primary));
+      vector<int> up2, acting2;
+      int up_primary2, acting_primary2;
+      map->pg_to_up_acting_osds(pgid, &up2, &up_primary2,
+				&acting2, &acting_primary2);
+      ASSERT_EQ(up2, up);
+      ASSERT_EQ(up_primary2, up_primary);
+      ASSERT_EQ(acting2, acting);
+      ASSERT_EQ(acting_primary2, acting_primary);
+    }
+    // pgs the job was not asked for and epochs never queued fall back
+    ASSERT_FALSE(precalc.get(e, later, &up, &up_primary,
+			     &acting, &acting_primary));
+    ASSERT_FALSE(precalc.get(e + 1, *pgids.begin(), &up, &up_primary,
+			     &acting, &acting_primary));
+
+    // stale epochs are dropped and fall back as well
+    precalc.cancel(e);
+    ASSERT_EQ(0u, precalc.size());
+    ASSERT_FALSE(precalc.get(e, *pgids.begin(), &up, &up_primary,
+			     &acting, &acting_primary));
+  }
+  tp.stop();
+}
+
 TEST_F(OSDMapTest, MapFunctionsMatch) {
   // TODO: make sure pg_to_up_acting_osds and pg_to_acting_osds match
   set_up_map();
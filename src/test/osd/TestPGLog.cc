@@ -2684,6 +2684,121 @@ TEST_F(PGLogMergeDupsTest, Superset) {
 }
 
 
+class PGLogTrimRangeDeleteTest : protected PGLog, public PGLogTestBase,
+				 public StoreTestFixture {
+public:
+  PGLogTrimRangeDeleteTest()
+    : PGLog(g_ceph_context), StoreTestFixture("memstore") {}
+
+  void SetUp() override {
+    StoreTestFixture::SetUp();
+    g_ceph_context->_conf.set_val_or_die("osd_pg_log_trim_range_delete", "true");
+    g_ceph_context->_conf.set_val_or_die("osd_pg_log_dups_tracked", "15");
+    ObjectStore::Transaction t;
+    test_coll = coll_t(spg_t(pg_t(1, 1)));
+    ch = store->create_new_collection(test_coll);
+    t.create_collection(test_coll, 0);
+    store->queue_transaction(ch, std::move(t));
+  }
+
+  void TearDown() override {
+    g_ceph_context->_conf.set_val_or_die("osd_pg_log_trim_range_delete", "false");
+    g_ceph_context->_conf.set_val_or_die("osd_pg_log_dups_tracked", "3000");
+    clear();
+    ch.reset();
+    StoreTestFixture::TearDown();
+  }
+
+  void add_entries(unsigned from, unsigned to) {
+    for (unsigned v = from; v <= to; ++v) {
+      add(mk_ple_mod(mk_obj(v), mk_evt(1, v), mk_evt(1, v - 1),
+		     osd_reqid_t(entity_name_t::CLIENT(777), 8, v)));
+    }
+    log.skip_can_rollback_to_to_head();
+  }
+
+  void write(const map<string, bufferlist>& extra = {}) {
+    ObjectStore::Transaction t;
+    map<string, bufferlist> km = extra;
+    write_log_and_missing(t, &km, test_coll, log_oid, false);
+    if (!km.empty()) {
+      t.omap_setkeys(test_coll, log_oid, km);
+    }
+    ASSERT_EQ(0, store->queue_transaction(ch, std::move(t)));
+  }
+
+  set<string> get_keys() {
+    set<string> keys;
+    EXPECT_EQ(0, store->omap_get_keys(ch, log_oid, &keys));
+    return keys;
+  }
+
+  coll_t test_coll;
+  ObjectStore::CollectionHandle ch;
+  ghobject_t log_oid{hobject_t(object_t("log"), "", CEPH_NOSNAP, 0, 1, "")};
+};
+
+TEST_F(PGLogTrimRangeDeleteTest, OnlyTrimmedKeysRemoved) {
+  pg_info_t info;
+  bufferlist info_bl;
+  info_bl.append("info");
+
+  // _info lives in the same object and sorts between the log entries
+  // and the dups, the missing set sorts after the dups
+  add_entries(1, 20);
+  missing.add(mk_obj(100), mk_evt(1, 20), eversion_t(), false);
+  write({{"_info", info_bl}});
+
+  info.last_complete = mk_evt(1, 10);
+  trim(mk_evt(1, 10), info);
+  write();
+
+  // trims the remaining entries up to 20 and dups 6..10
+  add_entries(21, 30);
+  info.last_complete = mk_evt(1, 20);
+  auto before = get_keys();
+  set<string> trimmed_keys;
+  for (unsigned v = 11; v <= 20; ++v) {
+    trimmed_keys.insert(mk_evt(1, v).get_key_name());
+  }
+  trim(mk_evt(1, 20), info);
+  ASSERT_GT(trimmed.size(), 1u);
+  ASSERT_GT(trimmed_dups.size(), 1u);
+  trimmed_keys.insert(trimmed_dups.begin(), trimmed_dups.end());
+  write();
+  auto after = get_keys();
+
+  for (auto& k : before) {
+    if (trimmed_keys.count(k)) {
+      EXPECT_EQ(0u, after.count(k)) << k << " was not trimmed";
+    } else {
+      EXPECT_EQ(1u, after.count(k)) << k << " was removed";
+    }
+  }
+  for (auto& d : log.dups) {
+    EXPECT_EQ(1u, after.count(d.get_key_name())) << d.get_key_name();
+  }
+  ASSERT_EQ(1u, after.count("_info"));
+  map<string, bufferlist> vals;
+  ASSERT_EQ(0, store->omap_get_values(ch, log_oid, {"_info"}, &vals));
+  ASSERT_TRUE(vals["_info"].contents_equal(info_bl));
+
+  // and the log reads back as it was written
+  auto orig_log = log.log;
+  auto orig_dups = log.dups;
+  clear();
+  ostringstream err;
+  info.last_update = mk_evt(1, 30);
+  read_log_and_missing(store.get(), ch, log_oid,
+		       info, err, false, false);
+  ASSERT_EQ(orig_dups, log.dups);
+  ASSERT_EQ(orig_log.size(), log.log.size());
+  ASSERT_EQ(orig_log.front().version, log.log.front().version);
+  ASSERT_EQ(orig_log.back().version, log.log.back().version);
+  ASSERT_TRUE(missing.is_missing(mk_obj(100)));
+}
+
+
 struct PGLogTrimTest :
   public ::testing::Test,
   public PGLogTestBase,
@@ -2922,6 +3037,46 @@ TEST_F(PGLogTrimTest, TestGetRequest) {
   EXPECT_FALSE(result);
 }
 
+// Reports what log entries cost in memory (as far as it is accounted to
+// the osd_pglog mempool) and how long trimming them takes.
+TEST_F(PGLogTrimTest, TestFootprint)
+{
+  const unsigned n = 10000;
+  SetUp(n);
+  entity_name_t client = entity_name_t::CLIENT(777);
+  size_t before = mempool::osd_pglog::allocated_bytes();
+  {
+    PGLog::IndexedLog log;
+    log.head = mk_evt(10, 0);
+    log.skip_can_rollback_to_to_head();
+
+    for (unsigned i = 1; i <= n; ++i) {
+      hobject_t hoid = mk_obj(i % 1024);
+      hoid.oid = fmt::format("rbd_data.10226b8b4567.{:016x}", i % 1024);
+      pg_log_entry_t e = mk_ple_mod(hoid, mk_evt(10, i), mk_evt(10, i - 1),
+				    osd_reqid_t(client, 8, i));
+      e.clean_regions.mark_data_region_dirty(4096 * (i % 64), 4096);
+      log.add(e);
+    }
+    size_t used = mempool::osd_pglog::allocated_bytes() - before;
+    std::cout << n << " entries: " << used / n << " bytes/entry"
+	      << " (sizeof(pg_log_entry_t) " << sizeof(pg_log_entry_t) << ")"
+	      << std::endl;
+
+    eversion_t write_from_dups = eversion_t::max();
+    auto start = ceph::mono_clock::now();
+    log.trim(cct, mk_evt(10, n / 2), nullptr, nullptr, &write_from_dups);
+    auto elapsed = ceph::mono_clock::now() - start;
+    std::cout << "trimmed " << n / 2 << " entries in "
+	      << std::chrono::duration<double>(elapsed).count() << "s"
+	      << std::endl;
+    EXPECT_EQ(n / 2, log.log.size());
+    EXPECT_EQ(n / 2, log.dups.size());
+    EXPECT_LT(mempool::osd_pglog::allocated_bytes() - before, used);
+  }
+  EXPECT_EQ(before, mempool::osd_pglog::allocated_bytes());
+}
+
 TEST_F(PGLogTest, _merge_object_divergent_entries) {
   {
     // Test for issue 20843